@@ -1,25 +1,103 @@
 #include "fatfs/FileAllocationTable.hpp"
 #include "fatfs/FileAllocationTable.impl.hpp"
+#include "fatfs/Helpers.hpp"
 
-Fatfs::FileAllocationTable::FileAllocationTable(std::string_view path)
+Fatfs::FileAllocationTable::FileAllocationTable(std::string_view    path,
+                                                const MountOptions &options)
 {
-    impl_ = std::make_unique<Implementation>(path);
+    impl_ = std::make_unique<Implementation>(path, options);
 }
 
 Fatfs::FileAllocationTable::~FileAllocationTable() = default;
 
+Fatfs::ReadContext::ReadContext(std::pmr::memory_resource *resource, bool direct)
+    : buffers_{std::make_unique<Buffers>(resource, direct)}
+{
+}
+
+Fatfs::ReadContext::~ReadContext() = default;
+
 std::vector<Fatfs::FileInfo>
 Fatfs::FileAllocationTable::ReadDirectory(std::string_view path) const
 {
     return impl_->ReadDirectory(path);
 }
 
+Fatfs::FileAllocationTable::DirectoryRange
+Fatfs::FileAllocationTable::IterateDirectory(std::string_view path) const
+{
+    return {*impl_, path};
+}
+
 std::vector<std::byte>
 Fatfs::FileAllocationTable::ReadFile(std::string_view path) const
 {
     return impl_->ReadFile(path);
 }
 
+std::pmr::vector<Fatfs::FileInfo>
+Fatfs::FileAllocationTable::ReadDirectory(std::string_view           path,
+                                          std::pmr::memory_resource *resource) const
+{
+    return impl_->ReadDirectory(path, resource);
+}
+
+std::pmr::vector<std::byte>
+Fatfs::FileAllocationTable::ReadFile(std::string_view           path,
+                                     std::pmr::memory_resource *resource) const
+{
+    return impl_->ReadFile(path, resource);
+}
+
+std::span<const Fatfs::FileInfo>
+Fatfs::FileAllocationTable::ReadDirectory(std::string_view path,
+                                          ReadContext     &context) const
+{
+    return impl_->ReadDirectory(path, *context.buffers_);
+}
+
+std::span<const std::byte>
+Fatfs::FileAllocationTable::ReadFile(std::string_view path,
+                                     ReadContext     &context) const
+{
+    return impl_->ReadFile(path, *context.buffers_);
+}
+
+Fatfs::FileInfo Fatfs::FileAllocationTable::Stat(std::string_view path) const
+{
+    return impl_->Stat(path);
+}
+
+Fatfs::FileInfo Fatfs::FileAllocationTable::Stat(std::string_view path,
+                                                 ReadContext     &context) const
+{
+    return impl_->Stat(path, *context.buffers_);
+}
+
+std::size_t Fatfs::FileAllocationTable::Read(std::string_view     path,
+                                             std::size_t          offset,
+                                             std::span<std::byte> buffer) const
+{
+    return impl_->Read(path, offset, buffer);
+}
+
+std::size_t Fatfs::FileAllocationTable::FileSize(std::string_view path) const
+{
+    return impl_->FileSize(path);
+}
+
+std::size_t Fatfs::FileAllocationTable::ReadFileInto(std::string_view     path,
+                                                     std::span<std::byte> buffer) const
+{
+    return impl_->ReadFileInto(path, buffer);
+}
+
+std::size_t Fatfs::FileAllocationTable::ReadFileTo(std::string_view path,
+                                                   int              fd) const
+{
+    return impl_->ReadFileTo(path, fd);
+}
+
 void Fatfs::FileAllocationTable::CreateFile(
     std::string_view              path,
     const std::vector<std::byte> &data) const
@@ -27,22 +105,263 @@ void Fatfs::FileAllocationTable::CreateFile(
     impl_->CreateFile(path, data);
 }
 
+void Fatfs::FileAllocationTable::CreateFile(
+    std::string_view           path,
+    std::istream              &data,
+    std::optional<std::size_t> size) const
+{
+    impl_->CreateFile(path, data, size);
+}
+
 void Fatfs::FileAllocationTable::CreateDirectory(std::string_view path) const
 {
     impl_->CreateDirectory(path);
 }
 
-void Fatfs::FileAllocationTable::DeleteEntry(std::string_view path) const
+void Fatfs::FileAllocationTable::Append(std::string_view           path,
+                                        std::span<const std::byte> data) const
+{
+    impl_->Append(path, data);
+}
+
+void Fatfs::FileAllocationTable::Write(std::string_view           path,
+                                       std::size_t                offset,
+                                       std::span<const std::byte> data) const
+{
+    impl_->Write(path, offset, data);
+}
+
+void Fatfs::FileAllocationTable::Truncate(std::string_view path,
+                                          std::size_t      size) const
+{
+    impl_->Truncate(path, size);
+}
+
+void Fatfs::FileAllocationTable::Preallocate(std::string_view path,
+                                             std::size_t      size,
+                                             bool             keepSize) const
+{
+    impl_->Preallocate(path, size, keepSize);
+}
+
+void Fatfs::FileAllocationTable::CompactDirectory(std::string_view path) const
+{
+    impl_->CompactDirectory(path);
+}
+
+void Fatfs::FileAllocationTable::DeleteEntry(std::string_view path,
+                                             bool             recursive) const
+{
+    impl_->DeleteEntry(path, recursive);
+}
+
+void Fatfs::FileAllocationTable::EraseEntry(std::string_view path,
+                                            bool             recursive) const
+{
+    impl_->EraseEntry(path, recursive);
+}
+
+void Fatfs::FileAllocationTable::Move(std::string_view source,
+                                      std::string_view destination) const
+{
+    impl_->Move(source, destination);
+}
+
+void Fatfs::FileAllocationTable::Copy(std::string_view source,
+                                      std::string_view destination) const
+{
+    impl_->Copy(source, destination);
+}
+
+void Fatfs::FileAllocationTable::Sync() const
+{
+    impl_->Sync();
+}
+
+void Fatfs::FileAllocationTable::Find(std::string_view    directory,
+                                      std::string_view    pattern,
+                                      const FindOptions  &options,
+                                      const FindCallback &callback) const
+{
+    impl_->Find(directory, pattern, options, callback);
+}
+
+Fatfs::CheckReport Fatfs::FileAllocationTable::Check(bool repair) const
+{
+    return impl_->Check(repair);
+}
+
+Fatfs::VolumeUsage Fatfs::FileAllocationTable::Usage() const
+{
+    return impl_->Usage();
+}
+
+std::vector<Fatfs::DirectoryUsage>
+Fatfs::FileAllocationTable::DiskUsage(std::string_view directory) const
+{
+    return impl_->DiskUsage(directory);
+}
+
+Fatfs::SyncReport
+Fatfs::FileAllocationTable::SyncFrom(std::string_view hostDirectory,
+                                     std::string_view directory) const
 {
-    impl_->DeleteEntry(path);
+    return impl_->SyncFrom(hostDirectory, directory);
 }
 
-void Fatfs::FileAllocationTable::EraseEntry(std::string_view path) const
+std::vector<Fatfs::FileChecksum>
+Fatfs::FileAllocationTable::Checksum(std::string_view directory,
+                                     bool             sha256) const
 {
-    impl_->EraseEntry(path);
+    return impl_->Checksum(directory, sha256);
 }
 
 Fatfs::FileSystemVersion Fatfs::FileAllocationTable::Version() const
 {
     return impl_->Version();
 }
+
+std::size_t Fatfs::FileAllocationTable::FreeSpace() const
+{
+    return impl_->FreeSpace();
+}
+
+Fatfs::DirectoryEntryView::DirectoryEntryView(
+    const Structures::DirectoryEntry &entry,
+    const std::chrono::seconds        utcOffset)
+    : entry_{entry},
+      utcOffset_{utcOffset}
+{
+}
+
+const Fatfs::Structures::DirectoryEntry &
+Fatfs::DirectoryEntryView::Raw() const
+{
+    return entry_;
+}
+
+std::string Fatfs::DirectoryEntryView::Name() const
+{
+    return Helpers::Path::ConvertFatPathToLongPath(
+        {reinterpret_cast<const char *>(entry_.Name),
+         std::size(entry_.Name) + std::size(entry_.Extension)});
+}
+
+std::time_t Fatfs::DirectoryEntryView::CreationTimestamp() const
+{
+    return std::chrono::system_clock::to_time_t(
+        Helpers::Time::ConvertFatTimeToUnixTime(entry_.CreationTime,
+                                                entry_.CreationDate,
+                                                utcOffset_));
+}
+
+std::time_t Fatfs::DirectoryEntryView::LastModificationTimestamp() const
+{
+    return std::chrono::system_clock::to_time_t(
+        Helpers::Time::ConvertFatTimeToUnixTime(entry_.LastModificationTime,
+                                                entry_.LastModificationDate,
+                                                utcOffset_));
+}
+
+std::time_t Fatfs::DirectoryEntryView::LastAccessDate() const
+{
+    return std::chrono::system_clock::to_time_t(
+        Helpers::Time::ConvertFatTimeToUnixTime({},
+                                                entry_.LastAccessDate,
+                                                utcOffset_));
+}
+
+std::size_t Fatfs::DirectoryEntryView::Size() const
+{
+    return entry_.FileSize;
+}
+
+bool Fatfs::DirectoryEntryView::IsDirectory() const
+{
+    return (entry_.Attributes & Structures::RawAttributes::Directory) != 0;
+}
+
+Fatfs::FileAllocationTable::DirectoryRange::DirectoryRange(
+    Implementation  &impl,
+    std::string_view path)
+    : impl_{&impl},
+      cursor_{std::make_unique<DirectoryCursor>(impl.OpenDirectory(path))}
+{
+}
+
+Fatfs::FileAllocationTable::DirectoryRange::DirectoryRange(
+    DirectoryRange &&) noexcept = default;
+
+Fatfs::FileAllocationTable::DirectoryRange &
+Fatfs::FileAllocationTable::DirectoryRange::operator=(
+    DirectoryRange &&) noexcept = default;
+
+Fatfs::FileAllocationTable::DirectoryRange::~DirectoryRange() = default;
+
+Fatfs::FileAllocationTable::DirectoryRange::Iterator
+Fatfs::FileAllocationTable::DirectoryRange::begin()
+{
+    // the first entry is read lazily, on the first call to begin()
+    if (!started_)
+    {
+        started_ = true;
+        Advance();
+    }
+
+    return Iterator{this};
+}
+
+std::default_sentinel_t Fatfs::FileAllocationTable::DirectoryRange::end() const
+{
+    return std::default_sentinel;
+}
+
+void Fatfs::FileAllocationTable::DirectoryRange::Advance()
+{
+    const Structures::DirectoryEntry *entry =
+        impl_->NextDirectoryEntry(*cursor_);
+
+    if (entry == nullptr)
+    {
+        atEnd_ = true;
+        return;
+    }
+
+    current_ = DirectoryEntryView{*entry, impl_->UtcOffset()};
+}
+
+Fatfs::FileAllocationTable::DirectoryRange::Iterator::Iterator(
+    DirectoryRange *range)
+    : range_{range}
+{
+}
+
+Fatfs::FileAllocationTable::DirectoryRange::Iterator::reference
+Fatfs::FileAllocationTable::DirectoryRange::Iterator::operator*() const
+{
+    return range_->current_;
+}
+
+Fatfs::FileAllocationTable::DirectoryRange::Iterator::pointer
+Fatfs::FileAllocationTable::DirectoryRange::Iterator::operator->() const
+{
+    return &range_->current_;
+}
+
+Fatfs::FileAllocationTable::DirectoryRange::Iterator &
+Fatfs::FileAllocationTable::DirectoryRange::Iterator::operator++()
+{
+    range_->Advance();
+    return *this;
+}
+
+void Fatfs::FileAllocationTable::DirectoryRange::Iterator::operator++(int)
+{
+    range_->Advance();
+}
+
+bool Fatfs::FileAllocationTable::DirectoryRange::Iterator::operator==(
+    std::default_sentinel_t) const
+{
+    return range_ == nullptr || range_->atEnd_;
+}
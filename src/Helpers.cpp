@@ -3,9 +3,11 @@
 #include "utilities/String.hpp"
 
 #include <algorithm>
+#include <cctype>
 #include <chrono>
+#include <cstring>
 #include <ctime>
-#include <sstream>
+#include <tuple>
 
 std::string
 Fatfs::Helpers::Path::ConvertLongPathToFatPath(const std::string_view name)
@@ -106,78 +108,279 @@ Fatfs::Helpers::Path::ConvertFatPathToLongPath(const std::string_view name)
     return result;
 }
 
-std::vector<std::string>
-Fatfs::Helpers::Path::SplitLongPathToFatComponents(const std::string_view path)
+Fatfs::Helpers::Path::FatName
+Fatfs::Helpers::Path::ConvertLongNameToFatName(const std::string_view name)
 {
-    std::string              tmp;
-    std::stringstream        ss{path.data()};
-    std::vector<std::string> pathComponents{};
+    const std::string_view r = Utilities::String::TrimStringView(name);
+
+    FatName result{};
+    result.fill(' ');
+
+    if (r == "." || r == "..")
+    {
+        // trivial cases (dot and dotdot)
+        std::copy(r.begin(), r.end(), result.begin());
+        return result;
+    }
+
+    auto       it  = r.begin();
+    const auto end = r.end();
+
+    // copy the first 8 characters or up to the first dot
+    for (std::size_t i = 0; i < 8 && it != end && *it != '.'; ++i, ++it)
+        result[i] = *it;
+
+    // skip dot
+    if (it != end && *it == '.')
+        ++it;
+
+    // copy the extension
+    for (std::size_t i = 8; i < 11 && it != end; ++i, ++it)
+        result[i] = *it;
+
+    // uppercase
+    std::transform(result.begin(),
+                   result.end(),
+                   result.begin(),
+                   [](const char c)
+                   {
+                       return static_cast<char>(
+                           std::toupper(static_cast<unsigned char>(c)));
+                   });
+
+    return result;
+}
+
+Fatfs::Helpers::Path::FatName
+Fatfs::Helpers::Path::ConvertPatternToFatMask(const std::string_view pattern)
+{
+    const std::string_view r = Utilities::String::TrimStringView(pattern);
+
+    FatName mask{};
+    mask.fill(' ');
+
+    // fills mask[first, last) from the pattern up to the next dot; * matches
+    // the rest of the field
+    auto       it   = r.begin();
+    const auto fill = [&](std::size_t first, std::size_t last)
+    {
+        for (std::size_t i = first; it != r.end() && *it != '.'; ++it)
+        {
+            if (*it == '*')
+            {
+                std::fill(mask.begin() + i, mask.begin() + last, '?');
+                i = last;
+            }
+            else if (i < last)
+            {
+                mask[i++] = static_cast<char>(
+                    std::toupper(static_cast<unsigned char>(*it)));
+            }
+        }
+    };
+
+    fill(0, 8);
+
+    if (it != r.end())
+    {
+        ++it; // dot
+        fill(8, 11);
+    }
+    else if (r.find('*') != std::string_view::npos)
+    {
+        std::fill(mask.begin() + 8, mask.end(), '?');
+    }
+
+    return mask;
+}
+
+bool Fatfs::Helpers::Path::MatchesFatMask(const FatName         &mask,
+                                          const std::string_view name)
+{
+    for (std::size_t i = 0; i < mask.size(); i++)
+    {
+        if (mask[i] != '?' && mask[i] != name[i])
+            return false;
+    }
+
+    return true;
+}
+
+Fatfs::Helpers::Path::FatComponents::Iterator::Iterator(
+    const std::string_view path,
+    const std::size_t      offset)
+    : path_{path},
+      offset_{offset},
+      next_{offset}
+{
+    Advance();
+}
+
+Fatfs::Helpers::Path::FatComponents::Iterator::reference
+Fatfs::Helpers::Path::FatComponents::Iterator::operator*() const
+{
+    return name_;
+}
+
+Fatfs::Helpers::Path::FatComponents::Iterator::pointer
+Fatfs::Helpers::Path::FatComponents::Iterator::operator->() const
+{
+    return &name_;
+}
 
-    // split on backslash
-    while (std::getline(ss, tmp, '\\'))
+Fatfs::Helpers::Path::FatComponents::Iterator &
+Fatfs::Helpers::Path::FatComponents::Iterator::operator++()
+{
+    Advance();
+    return *this;
+}
+
+Fatfs::Helpers::Path::FatComponents::Iterator
+Fatfs::Helpers::Path::FatComponents::Iterator::operator++(int)
+{
+    Iterator tmp = *this;
+    Advance();
+    return tmp;
+}
+
+bool Fatfs::Helpers::Path::FatComponents::Iterator::operator==(
+    const Iterator &other) const
+{
+    return offset_ == other.offset_;
+}
+
+std::size_t Fatfs::Helpers::Path::FatComponents::Iterator::Offset() const
+{
+    return offset_;
+}
+
+void Fatfs::Helpers::Path::FatComponents::Iterator::Advance()
+{
+    // skip separators and components that are nothing but spaces
+    while (next_ < path_.size())
     {
-        pathComponents.emplace_back(
-            ConvertLongPathToFatPath(Utilities::String::TrimString(tmp)));
+        std::size_t separator = path_.find('\\', next_);
+        if (separator == std::string_view::npos)
+            separator = path_.size();
+
+        const std::string_view component =
+            path_.substr(next_, separator - next_);
+
+        offset_ = next_;
+        next_   = separator + 1;
+
+        if (!Utilities::String::TrimStringView(component).empty())
+        {
+            name_ = ConvertLongNameToFatName(component);
+            return;
+        }
     }
 
-    // erase empty components
-    pathComponents.erase(
-        std::remove_if(pathComponents.begin(),
-                       pathComponents.end(),
-                       [](const std::string_view x)
-                       {
-                           return Utilities::String::TrimString(x).empty();
-                       }),
-        pathComponents.end());
+    offset_ = std::string_view::npos; // end
+}
+
+Fatfs::Helpers::Path::FatComponents::FatComponents(const std::string_view path)
+    : path_{path}
+{
+}
+
+Fatfs::Helpers::Path::FatComponents::Iterator
+Fatfs::Helpers::Path::FatComponents::begin() const
+{
+    return {path_, 0};
+}
+
+Fatfs::Helpers::Path::FatComponents::Iterator
+Fatfs::Helpers::Path::FatComponents::end() const
+{
+    return {path_, path_.size()};
+}
+
+bool Fatfs::Helpers::Path::FatComponents::empty() const
+{
+    return begin() == end();
+}
+
+Fatfs::Helpers::Path::FatName
+Fatfs::Helpers::Path::FatComponents::Back() const
+{
+    FatName last{};
+    for (const auto &component : *this)
+        last = component;
+
+    return last;
+}
+
+std::string_view Fatfs::Helpers::Path::FatComponents::Parent() const
+{
+    std::size_t last = 0;
+    for (auto it = begin(); it != end(); ++it)
+        last = it.Offset();
+
+    return path_.substr(0, last);
+}
+
+std::vector<std::string>
+Fatfs::Helpers::Path::SplitLongPathToFatComponents(const std::string_view path)
+{
+    std::vector<std::string> pathComponents{};
 
-    // resize if there are empty stuff
-    pathComponents.shrink_to_fit();
+    for (const auto &component : FatComponents{path})
+        pathComponents.emplace_back(component.begin(), component.end());
 
     return pathComponents;
 }
 
-std::chrono::system_clock::time_point
-Fatfs::Helpers::Time::ConvertFatTimeToUnixTime(Structures::TimeFormat time,
-                                               Structures::DateFormat date)
+Fatfs::Helpers::Time::UtcOffset Fatfs::Helpers::Time::LocalUtcOffset()
 {
-    std::tm timeTm{};
-    timeTm.tm_sec =
-        time.Second *
-        2; // multiply by 2 because FAT time is in 2 second intervals
-    timeTm.tm_min  = time.Minute;
-    timeTm.tm_hour = time.Hour;
-    timeTm.tm_mday = date.Day;
-    timeTm.tm_mon  = date.Month -
-                    1; // subtract 1 because FAT month is 1-12 and m_mon is 0-11
-    timeTm.tm_year = date.Year + 80; // add 80 because FAT year starts from 1980
-    // and tm_year is 1900-...
+    // the only place that consults the C library; evaluated once. always
+    // the standard offset, as mktime with tm_isdst = 0 used to apply to
+    // every timestamp, so that it doesn't depend on when it is evaluated
+    static const UtcOffset kOffset = []
+    {
+        const std::time_t now = std::time(nullptr);
+        std::tm           utc = *std::gmtime(&now);
+        utc.tm_isdst          = 0;
 
-    const std::time_t timeT = std::mktime(&timeTm);
+        return UtcOffset{now - std::mktime(&utc)};
+    }();
 
-    // return time_point
-    return std::chrono::system_clock::from_time_t(timeT);
+    return kOffset;
 }
 
-std::tuple<Fatfs::Structures::TimeFormat, Fatfs::Structures::DateFormat>
-Fatfs::Helpers::Time::ConvertUnixTimeToFatTime(
-    const std::chrono::system_clock::time_point &timePoint)
+void Fatfs::Helpers::Time::ConvertDirectoryTimes(
+    const std::span<const Structures::DirectoryEntry> entries,
+    const std::span<EntryTimes>                        times,
+    const UtcOffset                                    offset)
 {
-    const std::time_t timeT  = std::chrono::system_clock::to_time_t(timePoint);
-    const std::tm    *timeTm = std::localtime(&timeT);
+    // memoize the most recent date, as a raw 16-bit value
+    std::uint16_t lastDate = 0;
+    std::int64_t  lastDays = Detail::DaysSinceEpoch({});
+
+    const auto toSeconds = [&](const Structures::TimeFormat time,
+                               const Structures::DateFormat date)
+    {
+        std::uint16_t rawDate{};
+        std::memcpy(&rawDate, &date, sizeof rawDate);
 
-    Structures::TimeFormat time{};
-    Structures::DateFormat date{};
+        if (rawDate != lastDate)
+        {
+            lastDate = rawDate;
+            lastDays = Detail::DaysSinceEpoch(date);
+        }
 
-    date.Day   = timeTm->tm_mday;
-    date.Month = timeTm->tm_mon + 1;
-    date.Year =
-        timeTm->tm_year - 80; // 1980 is the base year; (struct tm*)->tm_year is
-    // the number of years since 1900
+        return static_cast<std::time_t>(lastDays * 86400 + time.Hour * 3600 +
+                                        time.Minute * 60 + time.Second * 2 -
+                                        offset.count());
+    };
 
-    time.Hour   = timeTm->tm_hour;
-    time.Minute = timeTm->tm_min;
-    time.Second = timeTm->tm_sec / 2; // 2 second resolution
+    for (std::size_t i = 0; i < entries.size() && i < times.size(); i++)
+    {
+        const auto &entry = entries[i];
 
-    // tuple of [time, date], can be deconstructed
-    return std::make_tuple(time, date);
-}
\ No newline at end of file
+        times[i].Creation = toSeconds(entry.CreationTime, entry.CreationDate);
+        times[i].LastModification =
+            toSeconds(entry.LastModificationTime, entry.LastModificationDate);
+        times[i].LastAccess = toSeconds({}, entry.LastAccessDate);
+    }
+}
@@ -1,5 +1,7 @@
 #include "utilities/String.hpp"
 
+#include <algorithm>
+
 std::string Utilities::String::TrimString(std::string_view str)
 {
     std::string result{str};
@@ -16,3 +18,12 @@ std::string Utilities::String::TrimString(std::string_view str)
 
     return result;
 }
+
+std::string_view Utilities::String::TrimStringView(std::string_view str)
+{
+    // same as TrimString, but returns a view into the argument
+    const auto last = str.find_last_not_of(' ');
+
+    return last == std::string_view::npos ? str.substr(0, 0)
+                                          : str.substr(0, last + 1);
+}
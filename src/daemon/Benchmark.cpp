@@ -0,0 +1,133 @@
+#include "fatfsd/Client.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+// load generator for fatfsd: every thread opens its own connection and issues
+// the same request back to back; latencies of all requests are pooled
+int main(const int argc, char *argv[])
+{
+    const std::vector<std::string> args{argv, argv + argc};
+
+    if (args.size() < 5)
+    {
+        std::cerr << "usage: " << args[0]
+                  << " <socket> <volume> <read|stat|list> <path> [threads] "
+                     "[requests per thread]"
+                  << std::endl;
+        return 1;
+    }
+
+    const std::string &socket    = args[1];
+    const std::string &volume    = args[2];
+    const std::string &operation = args[3];
+    const std::string &path      = args[4];
+
+    std::size_t threads  = 4;
+    std::size_t requests = 10000;
+
+    try
+    {
+        if (args.size() > 5)
+            threads = std::stoul(args[5]);
+        if (args.size() > 6)
+            requests = std::stoul(args[6]);
+    }
+    catch (const std::logic_error &)
+    {
+        std::cerr << "error: invalid number" << std::endl;
+        return 1;
+    }
+
+    if (operation != "read" && operation != "stat" && operation != "list")
+    {
+        std::cerr << "error: unknown operation \"" << operation << "\""
+                  << std::endl;
+        return 1;
+    }
+
+    using Clock = std::chrono::steady_clock;
+
+    std::vector<std::vector<Clock::duration>> latencies(threads);
+    std::vector<std::string>                  errors(threads);
+
+    const Clock::time_point start = Clock::now();
+
+    std::vector<std::thread> workers;
+    for (std::size_t t = 0; t < threads; t++)
+    {
+        workers.emplace_back(
+            [&, t]
+            {
+                try
+                {
+                    Fatfs::Daemon::Client client{socket};
+                    latencies[t].reserve(requests);
+
+                    for (std::size_t i = 0; i < requests; i++)
+                    {
+                        const Clock::time_point begin = Clock::now();
+
+                        if (operation == "read")
+                            static_cast<void>(client.ReadFile(volume, path));
+                        else if (operation == "stat")
+                            static_cast<void>(client.Stat(volume, path));
+                        else
+                            static_cast<void>(client.ReadDirectory(volume, path));
+
+                        latencies[t].push_back(Clock::now() - begin);
+                    }
+                }
+                catch (const std::runtime_error &e)
+                {
+                    errors[t] = e.what();
+                }
+            });
+    }
+
+    for (std::thread &worker : workers)
+        worker.join();
+
+    const std::chrono::duration<double> elapsed = Clock::now() - start;
+
+    for (const std::string &error : errors)
+    {
+        if (!error.empty())
+        {
+            std::cerr << "error: " << error << std::endl;
+            return 2;
+        }
+    }
+
+    std::vector<Clock::duration> all;
+    for (const auto &latency : latencies)
+        all.insert(all.end(), latency.begin(), latency.end());
+
+    if (all.empty())
+        return 0;
+
+    std::sort(all.begin(), all.end());
+
+    const auto percentile = [&](double p)
+    {
+        const std::size_t index =
+            std::min(all.size() - 1, static_cast<std::size_t>(p * all.size()));
+        return std::chrono::duration<double, std::micro>(all[index]).count();
+    };
+
+    std::cout << "requests:   " << all.size() << '\n'
+              << "throughput: " << all.size() / elapsed.count() << " req/s\n"
+              << "p50:        " << percentile(0.50) << " us\n"
+              << "p99:        " << percentile(0.99) << " us\n"
+              << "max:        "
+              << std::chrono::duration<double, std::micro>(all.back()).count()
+              << " us" << std::endl;
+
+    return 0;
+}
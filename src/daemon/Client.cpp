@@ -0,0 +1,121 @@
+#include "fatfsd/Client.hpp"
+#include "fatfs/Errors.hpp"
+
+#include <cerrno>
+#include <cstring>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+Fatfs::Daemon::Client::Client(std::string_view socketPath)
+{
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+
+    if (socketPath.size() >= sizeof address.sun_path)
+        throw std::runtime_error{"socket path too long"};
+    std::memcpy(address.sun_path, socketPath.data(), socketPath.size());
+
+    fd_ = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd_ < 0)
+        throw std::runtime_error{"failed to create socket"};
+
+    if (::connect(fd_, reinterpret_cast<const sockaddr *>(&address),
+                  sizeof address) != 0)
+    {
+        const int error = errno;
+        ::close(fd_);
+
+        throw std::runtime_error{"failed to connect to " +
+                                 std::string{socketPath} + ": " +
+                                 std::strerror(error)};
+    }
+}
+
+Fatfs::Daemon::Client::~Client()
+{
+    ::close(fd_);
+}
+
+std::vector<std::byte>
+Fatfs::Daemon::Client::ReadFile(std::string_view volume, std::string_view path)
+{
+    return Call(Opcode::ReadFile, volume, path);
+}
+
+std::vector<Fatfs::FileInfo>
+Fatfs::Daemon::Client::ReadDirectory(std::string_view volume,
+                                     std::string_view path)
+{
+    return DecodeFileInfos(Call(Opcode::ReadDirectory, volume, path));
+}
+
+Fatfs::FileInfo Fatfs::Daemon::Client::Stat(std::string_view volume,
+                                            std::string_view path)
+{
+    return DecodeFileInfo(Call(Opcode::Stat, volume, path));
+}
+
+void Fatfs::Daemon::Client::CreateFile(std::string_view           volume,
+                                       std::string_view           path,
+                                       std::span<const std::byte> data)
+{
+    static_cast<void>(Call(Opcode::CreateFile, volume, path, data));
+}
+
+void Fatfs::Daemon::Client::CreateDirectory(std::string_view volume,
+                                            std::string_view path)
+{
+    static_cast<void>(Call(Opcode::CreateDirectory, volume, path));
+}
+
+std::vector<std::byte>
+Fatfs::Daemon::Client::Call(Opcode                     op,
+                            std::string_view           volume,
+                            std::string_view           path,
+                            std::span<const std::byte> data)
+{
+    Request request{};
+    request.Id     = nextId_++;
+    request.Op     = op;
+    request.Volume = volume;
+    request.Path   = path;
+    request.Data.assign(data.begin(), data.end());
+
+    SendFrame(fd_, EncodeRequest(request));
+
+    std::vector<std::byte> frame;
+    if (!ReceiveFrame(fd_, frame))
+        throw ProtocolError{"daemon closed the connection"};
+
+    Response response = DecodeResponse(frame);
+    if (response.Id != request.Id)
+        throw ProtocolError{"response does not match request"};
+
+    const std::string message{reinterpret_cast<const char *>(response.Payload.data()),
+                              response.Payload.size()};
+
+    // same exceptions as a local volume would throw
+    switch (response.Result)
+    {
+    case Status::Ok:
+        return std::move(response.Payload);
+    case Status::FileNotFound:
+        throw Errors::FileNotFoundError{message};
+    case Status::DirectoryNotFound:
+        throw Errors::DirectoryNotFoundError{message};
+    case Status::FileAlreadyExists:
+        throw Errors::FileAlreadyExistsError{message};
+    case Status::InvalidPath:
+        throw Errors::InvalidPathError{message};
+    case Status::InvalidFileOperation:
+        throw Errors::InvalidFileOperationError{message};
+    case Status::FileSystemError:
+        throw Errors::FileSystemError{message};
+    case Status::BadRequest:
+        break;
+    }
+
+    throw ProtocolError{message};
+}
@@ -0,0 +1,306 @@
+#include "fatfsd/Protocol.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+namespace
+{
+
+using Fatfs::Daemon::ProtocolError;
+
+class Writer
+{
+  public:
+    explicit Writer(std::vector<std::byte> &out)
+        : out_(out)
+    {
+    }
+
+    template<typename T>
+    void Put(T value)
+    {
+        const auto bits = static_cast<std::uint64_t>(value);
+        for (std::size_t i = 0; i < sizeof(T); i++)
+            out_.push_back(static_cast<std::byte>(bits >> i * 8));
+    }
+
+    void PutString(std::string_view value)
+    {
+        if (value.size() > 0xFFFF)
+            throw ProtocolError{"string too long"};
+
+        Put<std::uint16_t>(value.size());
+        const auto *bytes = reinterpret_cast<const std::byte *>(value.data());
+        out_.insert(out_.end(), bytes, bytes + value.size());
+    }
+
+    void PutBlob(std::span<const std::byte> value)
+    {
+        Put<std::uint32_t>(value.size());
+        out_.insert(out_.end(), value.begin(), value.end());
+    }
+
+  private:
+    std::vector<std::byte> &out_;
+};
+
+class Reader
+{
+  public:
+    explicit Reader(std::span<const std::byte> in)
+        : in_(in)
+    {
+    }
+
+    template<typename T>
+    T Get()
+    {
+        const auto bytes = Take(sizeof(T));
+
+        std::uint64_t bits = 0;
+        for (std::size_t i = 0; i < sizeof(T); i++)
+            bits |= std::to_integer<std::uint64_t>(bytes[i]) << i * 8;
+
+        return static_cast<T>(bits);
+    }
+
+    std::string GetString()
+    {
+        const auto bytes = Take(Get<std::uint16_t>());
+        return {reinterpret_cast<const char *>(bytes.data()), bytes.size()};
+    }
+
+    std::vector<std::byte> GetBlob()
+    {
+        const auto bytes = Take(Get<std::uint32_t>());
+        return {bytes.begin(), bytes.end()};
+    }
+
+  private:
+    std::span<const std::byte> Take(std::size_t size)
+    {
+        if (in_.size() < size)
+            throw ProtocolError{"truncated message"};
+
+        const auto bytes = in_.first(size);
+        in_              = in_.subspan(size);
+        return bytes;
+    }
+
+    std::span<const std::byte> in_;
+};
+
+void SendAll(int fd, iovec *parts, int count)
+{
+    msghdr message{};
+    message.msg_iov    = parts;
+    message.msg_iovlen = count;
+
+    while (message.msg_iovlen > 0)
+    {
+        // MSG_NOSIGNAL: a vanished peer is an error, not a SIGPIPE
+        ssize_t sent = ::sendmsg(fd, &message, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR)
+            continue;
+        if (sent < 0)
+            throw ProtocolError{std::string{"send failed: "} +
+                                std::strerror(errno)};
+
+        // skip what went out, possibly ending in the middle of a part
+        while (message.msg_iovlen > 0 &&
+               static_cast<std::size_t>(sent) >= message.msg_iov->iov_len)
+        {
+            sent -= message.msg_iov->iov_len;
+            message.msg_iov++;
+            message.msg_iovlen--;
+        }
+
+        if (message.msg_iovlen > 0)
+        {
+            message.msg_iov->iov_base =
+                static_cast<char *>(message.msg_iov->iov_base) + sent;
+            message.msg_iov->iov_len -= sent;
+        }
+    }
+}
+
+// false on EOF before the first byte
+bool ReceiveAll(int fd, void *data, std::size_t size)
+{
+    auto       *bytes    = static_cast<char *>(data);
+    std::size_t received = 0;
+
+    while (received < size)
+    {
+        const ssize_t count = ::recv(fd, bytes + received, size - received, 0);
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count < 0)
+            throw ProtocolError{std::string{"receive failed: "} +
+                                std::strerror(errno)};
+        if (count == 0)
+        {
+            if (received == 0)
+                return false;
+
+            throw ProtocolError{"connection closed in the middle of a frame"};
+        }
+
+        received += count;
+    }
+
+    return true;
+}
+
+} // namespace
+
+std::vector<std::byte>
+Fatfs::Daemon::EncodeRequest(const Request &request)
+{
+    std::vector<std::byte> out;
+    out.reserve(16 + request.Volume.size() + request.Path.size() +
+                request.Data.size());
+
+    Writer writer{out};
+    writer.Put(request.Id);
+    writer.Put(static_cast<std::uint8_t>(request.Op));
+    writer.PutString(request.Volume);
+    writer.PutString(request.Path);
+    writer.PutBlob(request.Data);
+
+    return out;
+}
+
+Fatfs::Daemon::Request
+Fatfs::Daemon::DecodeRequest(std::span<const std::byte> frame)
+{
+    Reader  reader{frame};
+    Request request{};
+
+    request.Id     = reader.Get<std::uint32_t>();
+    request.Op     = static_cast<Opcode>(reader.Get<std::uint8_t>());
+    request.Volume = reader.GetString();
+    request.Path   = reader.GetString();
+    request.Data   = reader.GetBlob();
+
+    return request;
+}
+
+std::vector<std::byte>
+Fatfs::Daemon::EncodeResponse(const Response &response)
+{
+    std::vector<std::byte> out;
+    out.reserve(9 + response.Payload.size());
+
+    Writer writer{out};
+    writer.Put(response.Id);
+    writer.Put(static_cast<std::uint8_t>(response.Result));
+    writer.PutBlob(response.Payload);
+
+    return out;
+}
+
+Fatfs::Daemon::Response
+Fatfs::Daemon::DecodeResponse(std::span<const std::byte> frame)
+{
+    Reader   reader{frame};
+    Response response{};
+
+    response.Id      = reader.Get<std::uint32_t>();
+    response.Result  = static_cast<Status>(reader.Get<std::uint8_t>());
+    response.Payload = reader.GetBlob();
+
+    return response;
+}
+
+void Fatfs::Daemon::EncodeFileInfo(std::vector<std::byte> &out,
+                                   const FileInfo         &info)
+{
+    Writer writer{out};
+    writer.PutString(info.Name);
+    writer.Put<std::uint8_t>(info.IsDirectory);
+    writer.Put<std::uint32_t>(info.Size);
+    writer.Put<std::int64_t>(info.CreationTimestamp);
+    writer.Put<std::int64_t>(info.LastModificationTimestamp);
+    writer.Put<std::int64_t>(info.LastAccessDate);
+}
+
+namespace
+{
+
+Fatfs::FileInfo GetFileInfo(Reader &reader)
+{
+    Fatfs::FileInfo info{};
+    info.Name                      = reader.GetString();
+    info.IsDirectory               = reader.Get<std::uint8_t>() != 0;
+    info.Size                      = reader.Get<std::uint32_t>();
+    info.CreationTimestamp         = reader.Get<std::int64_t>();
+    info.LastModificationTimestamp = reader.Get<std::int64_t>();
+    info.LastAccessDate            = reader.Get<std::int64_t>();
+
+    return info;
+}
+
+} // namespace
+
+Fatfs::FileInfo
+Fatfs::Daemon::DecodeFileInfo(std::span<const std::byte> payload)
+{
+    Reader reader{payload};
+    return GetFileInfo(reader);
+}
+
+std::vector<Fatfs::FileInfo>
+Fatfs::Daemon::DecodeFileInfos(std::span<const std::byte> payload)
+{
+    Reader reader{payload};
+
+    const auto count = reader.Get<std::uint32_t>();
+
+    std::vector<FileInfo> infos;
+    infos.reserve(std::min<std::size_t>(count, payload.size()));
+
+    for (std::uint32_t i = 0; i < count; i++)
+        infos.emplace_back(GetFileInfo(reader));
+
+    return infos;
+}
+
+void Fatfs::Daemon::SendFrame(int fd, std::span<const std::byte> frame)
+{
+    if (frame.size() > kMaxFrameSize)
+        throw ProtocolError{"frame too large"};
+
+    std::byte length[4];
+    for (std::size_t i = 0; i < 4; i++)
+        length[i] = static_cast<std::byte>(frame.size() >> i * 8);
+
+    // header and body in one call, without copying the body
+    iovec parts[2] = {
+        {length, sizeof length},
+        {const_cast<std::byte *>(frame.data()), frame.size()},
+    };
+    SendAll(fd, parts, frame.empty() ? 1 : 2);
+}
+
+bool Fatfs::Daemon::ReceiveFrame(int fd, std::vector<std::byte> &frame)
+{
+    unsigned char length[4];
+    if (!ReceiveAll(fd, length, sizeof length))
+        return false;
+
+    const std::size_t size = length[0] | length[1] << 8 | length[2] << 16 |
+                             static_cast<std::size_t>(length[3]) << 24;
+    if (size > kMaxFrameSize)
+        throw ProtocolError{"frame too large"};
+
+    frame.resize(size);
+    if (size > 0 && !ReceiveAll(fd, frame.data(), size))
+        throw ProtocolError{"connection closed in the middle of a frame"};
+
+    return true;
+}
@@ -0,0 +1,348 @@
+#include "fatfs/Errors.hpp"
+#include "fatfs/FileAllocationTable.hpp"
+#include "fatfsd/Protocol.hpp"
+
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <csignal>
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace
+{
+
+using namespace Fatfs;
+using namespace Fatfs::Daemon;
+
+// reads go through each connection's direct ReadContext and share the lock,
+// so they run side by side; they still look at the in-memory FAT, which is
+// safe because creates change the table only with the lock to themselves.
+// creates then sync, so that later direct reads see them on disk
+struct Volume
+{
+    std::unique_ptr<FileAllocationTable> Table;
+    std::shared_mutex                    Mutex;
+};
+
+std::map<std::string, Volume, std::less<>> volumes;
+
+std::atomic<bool> stopping{false};
+
+// open connections, so that they can be shut down on exit
+std::mutex              connectionsMutex;
+std::condition_variable connectionsClosed;
+std::set<int>           connections;
+
+void Stop(int)
+{
+    stopping = true;
+}
+
+std::vector<std::byte> ToBytes(const std::string &message)
+{
+    const auto *bytes = reinterpret_cast<const std::byte *>(message.data());
+    return {bytes, bytes + message.size()};
+}
+
+// runs a change with the volume to itself; whatever it wrote, even if it
+// failed halfway, is synced before the readers come back
+template <typename F>
+void Change(Volume &volume, F &&change)
+{
+    const std::unique_lock lock{volume.Mutex};
+
+    try
+    {
+        change();
+    }
+    catch (...)
+    {
+        volume.Table->Sync();
+        throw;
+    }
+
+    volume.Table->Sync();
+}
+
+Response Handle(const Request &request, ReadContext &context)
+{
+    Response response{};
+    response.Id = request.Id;
+
+    const auto it = volumes.find(request.Volume);
+    if (it == volumes.end())
+    {
+        response.Result  = Status::BadRequest;
+        response.Payload = ToBytes("unknown volume " + request.Volume);
+        return response;
+    }
+
+    Volume &volume = it->second;
+
+    try
+    {
+        switch (request.Op)
+        {
+        case Opcode::ReadFile:
+        {
+            const std::shared_lock lock{volume.Mutex};
+
+            // a file that can't be sent is not read at all; a directory is
+            // left to ReadFile to reject
+            if (const FileInfo info = volume.Table->Stat(request.Path, context);
+                !info.IsDirectory && info.Size > kMaxPayloadSize)
+            {
+                response.Result  = Status::FileSystemError;
+                response.Payload = ToBytes(request.Path + " is too large to send (" +
+                                           std::to_string(info.Size) + " bytes)");
+                break;
+            }
+
+            const auto data = volume.Table->ReadFile(request.Path, context);
+            response.Payload.assign(data.begin(), data.end());
+        }
+        break;
+        case Opcode::ReadDirectory:
+        {
+            const std::shared_lock lock{volume.Mutex};
+
+            const auto infos = volume.Table->ReadDirectory(request.Path, context);
+
+            response.Payload.resize(sizeof(std::uint32_t));
+            for (std::size_t i = 0; i < sizeof(std::uint32_t); i++)
+                response.Payload[i] = static_cast<std::byte>(infos.size() >> i * 8);
+
+            for (const FileInfo &info : infos)
+                EncodeFileInfo(response.Payload, info);
+        }
+        break;
+        case Opcode::Stat:
+        {
+            const std::shared_lock lock{volume.Mutex};
+            EncodeFileInfo(response.Payload, volume.Table->Stat(request.Path, context));
+        }
+        break;
+        case Opcode::CreateFile:
+            Change(volume,
+                   [&] { volume.Table->CreateFile(request.Path, request.Data); });
+            break;
+        case Opcode::CreateDirectory:
+            Change(volume, [&] { volume.Table->CreateDirectory(request.Path); });
+            break;
+        default:
+            response.Result  = Status::BadRequest;
+            response.Payload = ToBytes("unknown opcode");
+        }
+    }
+    catch (const Errors::FileNotFoundError &e)
+    {
+        response.Result  = Status::FileNotFound;
+        response.Payload = ToBytes(e.what());
+    }
+    catch (const Errors::DirectoryNotFoundError &e)
+    {
+        response.Result  = Status::DirectoryNotFound;
+        response.Payload = ToBytes(e.what());
+    }
+    catch (const Errors::FileAlreadyExistsError &e)
+    {
+        response.Result  = Status::FileAlreadyExists;
+        response.Payload = ToBytes(e.what());
+    }
+    catch (const Errors::InvalidPathError &e)
+    {
+        response.Result  = Status::InvalidPath;
+        response.Payload = ToBytes(e.what());
+    }
+    catch (const Errors::InvalidFileOperationError &e)
+    {
+        response.Result  = Status::InvalidFileOperation;
+        response.Payload = ToBytes(e.what());
+    }
+    catch (const std::exception &e)
+    {
+        // anything else (e.g. running out of memory) fails this request only;
+        // escaping the connection's thread would end the daemon
+        response.Result  = Status::FileSystemError;
+        response.Payload = ToBytes(e.what());
+    }
+
+    return response;
+}
+
+// one thread per connection; requests on a connection are answered in order
+void Serve(int fd)
+{
+    std::vector<std::byte> frame;
+
+    // reads directories and data from disk and leaves the tables' caches
+    // alone, so that this connection's reads can share the lock
+    ReadContext context{std::pmr::get_default_resource(), true};
+
+    try
+    {
+        while (ReceiveFrame(fd, frame))
+        {
+            Response response{};
+
+            try
+            {
+                response = Handle(DecodeRequest(frame), context);
+            }
+            catch (const ProtocolError &e)
+            {
+                response.Result  = Status::BadRequest;
+                response.Payload = ToBytes(e.what());
+            }
+
+            std::vector<std::byte> out = EncodeResponse(response);
+
+            // e.g. a huge listing; the client gets an error instead of a
+            // closed connection
+            if (out.size() > kMaxFrameSize)
+            {
+                response.Result  = Status::FileSystemError;
+                response.Payload = ToBytes("response too large to send");
+                out              = EncodeResponse(response);
+            }
+
+            SendFrame(fd, out);
+        }
+    }
+    catch (const ProtocolError &)
+    {
+        // broken connection; nothing to answer
+    }
+
+    const std::lock_guard lock{connectionsMutex};
+
+    connections.erase(fd);
+    ::close(fd);
+
+    connectionsClosed.notify_all();
+}
+
+int Listen(const std::string &path)
+{
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+
+    if (path.size() >= sizeof address.sun_path)
+        throw std::runtime_error{"socket path too long"};
+    std::memcpy(address.sun_path, path.data(), path.size());
+
+    const int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        throw std::runtime_error{"failed to create socket"};
+
+    // a socket left behind by an earlier run would make bind fail
+    ::unlink(path.c_str());
+
+    if (::bind(fd, reinterpret_cast<const sockaddr *>(&address),
+               sizeof address) != 0 ||
+        ::listen(fd, SOMAXCONN) != 0)
+    {
+        const int error = errno;
+        ::close(fd);
+
+        throw std::runtime_error{"failed to listen on " + path + ": " +
+                                 std::strerror(error)};
+    }
+
+    return fd;
+}
+
+} // namespace
+
+int main(const int argc, char *argv[])
+{
+    const std::vector<std::string> args{argv, argv + argc};
+
+    if (args.size() < 3)
+    {
+        std::cerr << "usage: " << args[0]
+                  << " <socket> [<name>=]<volume>..." << std::endl;
+        return 1;
+    }
+
+    int listener = -1;
+
+    try
+    {
+        for (std::size_t i = 2; i < args.size(); i++)
+        {
+            // volumes are addressed by name, which defaults to their path
+            const std::size_t separator = args[i].find('=');
+            const std::string name =
+                separator == std::string::npos ? args[i]
+                                               : args[i].substr(0, separator);
+            const std::string path = separator == std::string::npos
+                                       ? args[i]
+                                       : args[i].substr(separator + 1);
+
+            volumes[name].Table = std::make_unique<FileAllocationTable>(path);
+        }
+
+        listener = Listen(args[1]);
+    }
+    catch (const std::runtime_error &e)
+    {
+        std::cerr << "error: " << e.what() << std::endl;
+        return 2;
+    }
+
+    struct sigaction action{};
+    action.sa_handler = Stop;
+    ::sigaction(SIGINT, &action, nullptr);
+    ::sigaction(SIGTERM, &action, nullptr);
+
+    // poll with a timeout, so that a signal is noticed even without clients
+    while (!stopping)
+    {
+        pollfd listening{listener, POLLIN, 0};
+        if (::poll(&listening, 1, 200) <= 0)
+            continue;
+
+        const int fd = ::accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0)
+            continue;
+
+        const std::lock_guard lock{connectionsMutex};
+
+        connections.insert(fd);
+        std::thread{Serve, fd}.detach();
+    }
+
+    // wake up workers blocked on their clients, then let them finish
+    {
+        std::unique_lock lock{connectionsMutex};
+
+        for (const int fd : connections)
+            ::shutdown(fd, SHUT_RDWR);
+
+        connectionsClosed.wait(lock, [] { return connections.empty(); });
+    }
+
+    ::close(listener);
+    ::unlink(args[1].c_str());
+
+    // unmounting writes back whatever is still pending
+    volumes.clear();
+
+    return 0;
+}
@@ -1,7 +1,18 @@
 #pragma once
 
+#include "fatfs/Structures.hpp"
+
+#include <chrono>
+#include <cstdint>
 #include <ctime>
+#include <functional>
+#include <istream>
+#include <iterator>
+#include <limits>
 #include <memory>
+#include <memory_resource>
+#include <optional>
+#include <span>
 #include <string>
 #include <string_view>
 #include <vector>
@@ -28,10 +39,181 @@ struct FileInfo
     bool IsDirectory;
 };
 
+// a directory entry as read from disk; name and timestamps are decoded only
+// when asked for
+class DirectoryEntryView
+{
+  public:
+    DirectoryEntryView() = default;
+    DirectoryEntryView(const Structures::DirectoryEntry &entry,
+                       std::chrono::seconds              utcOffset);
+
+    [[nodiscard]] const Structures::DirectoryEntry &Raw() const;
+
+    [[nodiscard]] std::string Name() const;
+
+    [[nodiscard]] std::time_t CreationTimestamp() const;
+    [[nodiscard]] std::time_t LastModificationTimestamp() const;
+    [[nodiscard]] std::time_t LastAccessDate() const;
+
+    [[nodiscard]] std::size_t Size() const; // 0 if directory
+    [[nodiscard]] bool        IsDirectory() const;
+
+  private:
+    Structures::DirectoryEntry entry_{};
+    std::chrono::seconds       utcOffset_{};
+};
+
+struct DirectoryCursor;
+struct EntryLocation;
+struct FatReader;
+
+struct MountOptions
+{
+    // upper bound on FAT sectors kept in memory; if the active FAT is
+    // larger, it is paged in on demand instead of being read at mount
+    std::size_t FatCacheSectors = 8192;
+
+    // offset from UTC that on-disk timestamps are written in; defaults to
+    // the host's standard local offset, ignoring daylight saving time
+    std::optional<std::chrono::seconds> UtcOffset;
+
+    // sidecar file for a write-ahead journal of metadata updates
+    std::optional<std::string> JournalPath;
+
+    // number of operations whose FAT and FSInfo updates are written (or, with
+    // a journal, committed) together; Sync and unmounting write early.
+    // defaults to 1 without a journal and 64 with one
+    std::optional<std::size_t> OperationsPerFlush;
+};
+
+enum class EntryType
+{
+    Any,
+    File,
+    Directory,
+};
+
+// filters for FileAllocationTable::Find besides the name pattern; directories
+// have size 0
+struct FindOptions
+{
+    EntryType   Type    = EntryType::Any;
+    std::size_t MinSize = 0;
+    std::size_t MaxSize = std::numeric_limits<std::size_t>::max();
+};
+
+// receives each match with its full path, one call at a time; returning false
+// ends the search
+using FindCallback =
+    std::function<bool(std::string_view path, const DirectoryEntryView &entry)>;
+
+// result of FileAllocationTable::Check; counters cover every problem found,
+// Problems describes the first few hundred
+struct CheckReport
+{
+    std::size_t Directories{};
+    std::size_t Files{};
+
+    std::size_t CrossLinkedClusters{}; // claimed by a second chain
+    std::size_t Loops{};               // chains that run into themselves
+    std::size_t BrokenChains{};  // running into free, bad or invalid clusters
+    std::size_t SizeMismatches{}; // file sizes past the end of their chain
+    std::size_t LostChains{};    // allocated, but not reachable from a file
+    std::size_t LostClusters{};
+    std::size_t FatMismatches{}; // sectors in which a FAT copy differs
+    bool        FreeCountMismatch{}; // FSInfo free count is off
+
+    std::vector<std::string> Problems;
+    std::size_t              UnlistedProblems{};
+
+    bool Repaired{};
+
+    [[nodiscard]] bool Clean() const
+    {
+        return Problems.empty();
+    }
+};
+
+// cluster counts of a whole volume, as FileAllocationTable::Usage reads them
+// from the FAT
+struct VolumeUsage
+{
+    std::size_t ClusterSize{}; // in bytes
+    std::size_t TotalClusters{};
+    std::size_t UsedClusters{};
+    std::size_t FreeClusters{};
+    std::size_t BadClusters{};
+};
+
+// totals of a directory and everything below it; AllocatedBytes counts whole
+// clusters, including those of the directories themselves
+struct DirectoryUsage
+{
+    std::string Path;
+    std::size_t Files{};
+    std::size_t Directories{}; // below this one
+    std::size_t Bytes{};       // sum of the file sizes
+    std::size_t AllocatedBytes{};
+};
+
+// one line of a manifest made by FileAllocationTable::Checksum
+struct FileChecksum
+{
+    std::string   Path;
+    std::size_t   Size{};
+    std::uint32_t Crc32c{};
+    std::string   Sha256; // lowercase hex; empty unless asked for
+};
+
+// what FileAllocationTable::SyncFrom changed
+struct SyncReport
+{
+    std::size_t Created{};   // files and directories
+    std::size_t Updated{};   // files rewritten
+    std::size_t Deleted{};   // entries, each with everything below it
+    std::size_t Unchanged{}; // files left alone
+
+    std::vector<std::string> Skipped; // host paths with no 8.3 name
+};
+
+// scratch space for reads, kept between calls; once its buffers have grown to
+// the largest file and directory read through it, reads through the context
+// no longer allocate. the buffers come from resource, which has to outlive
+// the context. not safe for concurrent use; keep one per thread.
+//
+// a direct context reads directories and file data from the volume on disk,
+// and a paged FAT through a page of its own; an FAT held in memory is read
+// where it is. it only reads, so reads through direct contexts (one per
+// thread) may run side by side, as long as nothing changes the table
+// meanwhile (e.g. they hold a shared lock that every other call takes
+// exclusively). changes have to be written out with Sync before they are
+// visible
+class ReadContext
+{
+  public:
+    explicit ReadContext(
+        std::pmr::memory_resource *resource = std::pmr::get_default_resource(),
+        bool                       direct   = false);
+    ~ReadContext();
+
+    ReadContext(const ReadContext &)            = delete;
+    ReadContext &operator=(const ReadContext &) = delete;
+
+  private:
+    friend class FileAllocationTable;
+
+    struct Buffers;
+    std::unique_ptr<Buffers> buffers_;
+};
+
 class FileAllocationTable
 {
   public:
-    explicit FileAllocationTable(std::string_view path);
+    class DirectoryRange;
+
+    explicit FileAllocationTable(std::string_view    path,
+                                 const MountOptions &options = {});
     ~FileAllocationTable();
 
     // delete copy and move constructors and assignment operators
@@ -43,18 +225,176 @@ class FileAllocationTable
 
     [[nodiscard]] std::vector<FileInfo>
     ReadDirectory(std::string_view path) const;
+    [[nodiscard]] DirectoryRange IterateDirectory(std::string_view path) const;
+    // the entry at path; the root directory has an empty name
+    [[nodiscard]] FileInfo Stat(std::string_view path) const;
     [[nodiscard]] std::vector<std::byte> ReadFile(std::string_view path) const;
+    // the same, allocating the results (and any scratch space) from resource
+    [[nodiscard]] std::pmr::vector<FileInfo>
+    ReadDirectory(std::string_view path, std::pmr::memory_resource *resource) const;
+    [[nodiscard]] std::pmr::vector<std::byte>
+    ReadFile(std::string_view path, std::pmr::memory_resource *resource) const;
+    // the same, into the buffers of context; the result stays valid until
+    // context is used again
+    [[nodiscard]] std::span<const FileInfo>
+    ReadDirectory(std::string_view path, ReadContext &context) const;
+    [[nodiscard]] std::span<const std::byte>
+    ReadFile(std::string_view path, ReadContext &context) const;
+    [[nodiscard]] FileInfo Stat(std::string_view path, ReadContext &context) const;
+    // reads up to buffer.size() bytes from offset; returns the number read
+    std::size_t Read(std::string_view     path,
+                     std::size_t          offset,
+                     std::span<std::byte> buffer) const;
+    // size of the file at path, from its directory entry alone
+    [[nodiscard]] std::size_t FileSize(std::string_view path) const;
+    // reads the whole file straight into buffer, which must hold at least
+    // FileSize(path) bytes; returns the number of bytes written
+    std::size_t ReadFileInto(std::string_view path, std::span<std::byte> buffer) const;
+    // writes the whole file to a file descriptor (file, pipe or socket);
+    // contiguous runs are copied by the kernel without passing through user
+    // space. returns the number of bytes written
+    std::size_t ReadFileTo(std::string_view path, int fd) const;
 
     void CreateFile(std::string_view path, const std::vector<std::byte> &data) const;
+    // streams the file from data in chunks instead of holding it in memory;
+    // size, if known, lets the clusters be reserved as one run beforehand
+    void CreateFile(std::string_view           path,
+                    std::istream              &data,
+                    std::optional<std::size_t> size = std::nullopt) const;
     void CreateDirectory(std::string_view path) const;
 
-    void DeleteEntry(std::string_view path) const;
-    void EraseEntry(std::string_view path) const;
+    // write into existing files, reusing their cluster chains; writing past
+    // the end grows the file and zero-fills any gap
+    void Append(std::string_view path, std::span<const std::byte> data) const;
+    void Write(std::string_view           path,
+               std::size_t                offset,
+               std::span<const std::byte> data) const;
+    void Truncate(std::string_view path, std::size_t size) const;
+
+    // reserves size bytes for a file as one contiguous run of clusters where
+    // possible, creating the file if needed; later writes fill the reserved
+    // clusters. unless keepSize is set, the file is grown to size with zeros
+    void Preallocate(std::string_view path,
+                     std::size_t      size,
+                     bool             keepSize = true) const;
+
+    // rewrites a directory without its deleted slots and frees the clusters
+    // that are no longer needed
+    void CompactDirectory(std::string_view path) const;
+
+    // marks the entry as deleted and frees its clusters; directories must be
+    // empty unless recursive is set, in which case the whole subtree goes
+    // with a single metadata flush
+    void DeleteEntry(std::string_view path, bool recursive = false) const;
+    // like DeleteEntry, but zeroes the freed clusters first
+    void EraseEntry(std::string_view path, bool recursive = false) const;
+
+    // renames or moves a file or directory; only directory entries are
+    // rewritten, the data stays where it is
+    void Move(std::string_view source, std::string_view destination) const;
+    // duplicates a file; the copy gets its clusters as one run where
+    // possible, and the data moves in large blocks, the next one being read
+    // while the last is written, so memory use doesn't grow with the file
+    void Copy(std::string_view source, std::string_view destination) const;
+
+    // writes out pending FAT, FSInfo and journal updates, and data still
+    // buffered, so that the volume on disk is up to date
+    void Sync() const;
+
+    // searches directory and everything below it (in parallel) for entries
+    // whose 8.3 name matches pattern, e.g. "*.TXT" or "LOG??.*"
+    void Find(std::string_view    directory,
+              std::string_view    pattern,
+              const FindOptions  &options,
+              const FindCallback &callback) const;
+
+    // walks every directory (in parallel) and cross-checks chains against
+    // the FAT; with repair, cuts bad chains, frees lost clusters and
+    // rewrites FAT copies that went out of step
+    [[nodiscard]] CheckReport Check(bool repair = false) const;
+
+    // space accounting from metadata alone; no file data is read. Usage
+    // counts the FAT, DiskUsage sums directory entries and chain lengths for
+    // directory and each directory below it (in parallel), sorted by path
+    [[nodiscard]] VolumeUsage Usage() const;
+    [[nodiscard]] std::vector<DirectoryUsage>
+    DiskUsage(std::string_view directory) const;
+
+    // makes directory a copy of hostDirectory on the host. files whose size
+    // or modification time differ are rewritten over their existing chains,
+    // missing ones are created and entries the host doesn't have are
+    // deleted; unchanged files are not read. with a journal, the FAT and
+    // FSInfo are committed once, at the end
+    SyncReport SyncFrom(std::string_view hostDirectory,
+                        std::string_view directory) const;
+
+    // hashes every file in directory and below it, sorted by path. files are
+    // read straight from the volume in runs of contiguous clusters and
+    // hashed on several threads; sha256 adds the stronger, slower hash
+    [[nodiscard]] std::vector<FileChecksum>
+    Checksum(std::string_view directory, bool sha256 = false) const;
 
     [[nodiscard]] FileSystemVersion Version() const;
+    [[nodiscard]] std::size_t       FreeSpace() const; // in bytes
+
   private:
+    friend struct FatReader;
+
     // PImpl idiom
     class Implementation;
     std::unique_ptr<Implementation> impl_;
 };
+
+// single-pass range over a directory; clusters are read only when iteration
+// reaches them, so stopping early leaves the rest of the directory unread.
+// The range must not outlive the FileAllocationTable, and modifying the
+// directory while iterating over it leaves the range in an unspecified state.
+class FileAllocationTable::DirectoryRange
+{
+  public:
+    class Iterator
+    {
+      public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type        = DirectoryEntryView;
+        using difference_type   = std::ptrdiff_t;
+        using pointer           = const DirectoryEntryView *;
+        using reference         = const DirectoryEntryView &;
+
+        Iterator() = default;
+
+        reference operator*() const;
+        pointer   operator->() const;
+
+        Iterator &operator++();
+        void      operator++(int);
+
+        bool operator==(std::default_sentinel_t) const;
+
+      private:
+        friend class DirectoryRange;
+        explicit Iterator(DirectoryRange *range);
+
+        DirectoryRange *range_{};
+    };
+
+    DirectoryRange(DirectoryRange &&) noexcept;
+    DirectoryRange &operator=(DirectoryRange &&) noexcept;
+    ~DirectoryRange();
+
+    [[nodiscard]] Iterator                begin();
+    [[nodiscard]] std::default_sentinel_t end() const;
+
+  private:
+    friend class FileAllocationTable;
+    DirectoryRange(Implementation &impl, std::string_view path);
+
+    void Advance();
+
+    Implementation                  *impl_;
+    std::unique_ptr<DirectoryCursor> cursor_;
+    DirectoryEntryView               current_{};
+    bool                             started_{};
+    bool                             atEnd_{};
+};
 } // namespace fatfs
@@ -3,10 +3,16 @@
 
 #include "fatfs/Structures.hpp"
 
+#include <array>
 #include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <span>
 #include <ctime>
 #include <string>
 #include <string_view>
+#include <tuple>
 #include <vector>
 
 namespace Fatfs
@@ -16,21 +22,199 @@ namespace Helpers
 
 namespace Path
 {
+// 8.3 name exactly as stored in DirectoryEntry::Name and ::Extension
+using FatName = std::array<char, 11>;
+
 std::string ConvertLongPathToFatPath(std::string_view name);
 std::string ConvertFatPathToLongPath(std::string_view name);
 
+FatName ConvertLongNameToFatName(std::string_view name);
+
+// 8.3 pattern with * and ? wildcards, laid out like a FatName; '?' stands for
+// any character. a pattern without a dot but with a * matches any extension
+FatName ConvertPatternToFatMask(std::string_view pattern);
+// name: the 11 bytes of DirectoryEntry::Name and ::Extension
+bool MatchesFatMask(const FatName &mask, std::string_view name);
+
+// splits a backslash-separated path into 8.3 keys lazily, without allocating
+class FatComponents
+{
+  public:
+    class Iterator
+    {
+      public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type        = FatName;
+        using difference_type   = std::ptrdiff_t;
+        using pointer           = const FatName *;
+        using reference         = const FatName &;
+
+        Iterator() = default;
+        Iterator(std::string_view path, std::size_t offset);
+
+        reference operator*() const;
+        pointer   operator->() const;
+
+        Iterator &operator++();
+        Iterator  operator++(int);
+
+        bool operator==(const Iterator &other) const;
+
+        // offset of the current component in the path
+        [[nodiscard]] std::size_t Offset() const;
+
+      private:
+        std::string_view path_;
+        std::size_t      offset_{}; // start of the current component
+        std::size_t      next_{};   // start of the unparsed remainder
+        FatName          name_{};
+
+        void Advance();
+    };
+
+    explicit FatComponents(std::string_view path);
+
+    [[nodiscard]] Iterator begin() const;
+    [[nodiscard]] Iterator end() const;
+
+    [[nodiscard]] bool empty() const;
+
+    [[nodiscard]] FatName Back() const;
+
+    // everything before the last component (empty for the root directory)
+    [[nodiscard]] std::string_view Parent() const;
+
+  private:
+    std::string_view path_;
+};
+
 std::vector<std::string> SplitLongPathToFatComponents(std::string_view path);
 } // namespace Path
 
 namespace Time
 {
-std::chrono::system_clock::time_point
-ConvertFatTimeToUnixTime(Structures::TimeFormat time,
-                         Structures::DateFormat date);
+// FAT timestamps are wall-clock times without a zone; they are interpreted
+// at a fixed offset from UTC (east positive) instead of going through the
+// C library's time zone machinery
+using UtcOffset = std::chrono::seconds;
+
+// standard (non daylight saving) offset of the host's local time zone,
+// computed once; the same for every timestamp, whatever the time of year
+UtcOffset LocalUtcOffset();
+
+namespace Detail
+{
+constexpr bool IsLeapYear(const int year)
+{
+    return (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+}
+
+// days from 1970-01-01 to January 1st of each year representable in FAT
+// (1980..2107)
+constexpr std::array<std::int32_t, 128> kDaysBeforeYear = []
+{
+    std::array<std::int32_t, 128> table{};
+
+    std::int32_t days = 3652; // 1970-01-01 .. 1980-01-01
+    for (int i = 0; i < 128; i++)
+    {
+        table[i] = days;
+        days += IsLeapYear(1980 + i) ? 366 : 365;
+    }
+
+    return table;
+}();
+
+// days from January 1st to the first of each month, for common and leap
+// years
+constexpr std::array<std::array<std::int16_t, 12>, 2> kDaysBeforeMonth{
+    {{0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334},
+     {0, 31, 60, 91, 121, 152, 182, 213, 244, 274, 305, 335}}};
+
+constexpr std::int64_t DaysSinceEpoch(const Structures::DateFormat date)
+{
+    // a zeroed date (unset field) is treated as 1980-01-01
+    const int month = date.Month < 1 ? 1 : date.Month > 12 ? 12 : date.Month;
+    const int day   = date.Day < 1 ? 1 : date.Day;
+
+    return kDaysBeforeYear[date.Year] +
+           kDaysBeforeMonth[IsLeapYear(1980 + date.Year)][month - 1] + day - 1;
+}
+} // namespace Detail
+
+constexpr std::chrono::system_clock::time_point
+ConvertFatTimeToUnixTime(const Structures::TimeFormat time,
+                         const Structures::DateFormat date,
+                         const UtcOffset              offset = {})
+{
+    const std::int64_t seconds = Detail::DaysSinceEpoch(date) * 86400 +
+                                 time.Hour * 3600 + time.Minute * 60 +
+                                 time.Second * 2; // 2 second resolution
+
+    return std::chrono::system_clock::time_point{std::chrono::seconds{seconds} -
+                                                 offset};
+}
+
+constexpr std::tuple<Structures::TimeFormat, Structures::DateFormat>
+ConvertUnixTimeToFatTime(const std::chrono::system_clock::time_point &timePoint,
+                         const UtcOffset offset = {})
+{
+    constexpr std::int64_t kMinimum =
+        std::int64_t{Detail::kDaysBeforeYear.front()} * 86400;
+    constexpr std::int64_t kMaximum =
+        (std::int64_t{Detail::kDaysBeforeYear.back()} + 366) * 86400 - 1;
+
+    // clamp to the range representable by FAT (1980..2107)
+    std::int64_t seconds =
+        std::chrono::floor<std::chrono::seconds>(timePoint.time_since_epoch() +
+                                                 offset)
+            .count();
+    seconds = seconds < kMinimum ? kMinimum
+            : seconds > kMaximum ? kMaximum
+                                 : seconds;
+
+    const auto days          = static_cast<std::int32_t>(seconds / 86400);
+    const auto secondsInDays = static_cast<std::int32_t>(seconds % 86400);
+
+    // find the year, then the month, by walking the tables backwards
+    int year = 127;
+    while (Detail::kDaysBeforeYear[year] > days)
+        year--;
+
+    const int  dayOfYear = days - Detail::kDaysBeforeYear[year];
+    const bool isLeap    = Detail::IsLeapYear(1980 + year);
+
+    int month = 11;
+    while (Detail::kDaysBeforeMonth[isLeap][month] > dayOfYear)
+        month--;
+
+    Structures::TimeFormat time{};
+    Structures::DateFormat date{};
+
+    date.Day   = dayOfYear - Detail::kDaysBeforeMonth[isLeap][month] + 1;
+    date.Month = month + 1;
+    date.Year  = year; // 1980 is the base year
+
+    time.Hour   = secondsInDays / 3600;
+    time.Minute = secondsInDays / 60 % 60;
+    time.Second = secondsInDays % 60 / 2; // 2 second resolution
+
+    // tuple of [time, date], can be deconstructed
+    return {time, date};
+}
+
+struct EntryTimes
+{
+    std::time_t Creation;
+    std::time_t LastModification;
+    std::time_t LastAccess;
+};
 
-std::tuple<Fatfs::Structures::TimeFormat, Fatfs::Structures::DateFormat>
-ConvertUnixTimeToFatTime(
-    const std::chrono::system_clock::time_point &timePoint);
+// converts the timestamps of a whole directory at once; entries written in
+// the same session usually share dates, so day counts are reused
+void ConvertDirectoryTimes(std::span<const Structures::DirectoryEntry> entries,
+                           std::span<EntryTimes>                        times,
+                           UtcOffset offset = {});
 } // namespace Time
 
 } // namespace Helpers
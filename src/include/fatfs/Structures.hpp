@@ -86,6 +86,17 @@ struct BiosParameterBlock
     } Offset36;
 };
 
+struct FsInfoSector
+{
+    std::uint32_t LeadSignature; // 0x41615252
+    std::uint8_t  Reserved1[480];
+    std::uint32_t StructSignature;  // 0x61417272
+    std::uint32_t FreeClusterCount; // 0xFFFFFFFF if unknown
+    std::uint32_t NextFreeCluster;  // 0xFFFFFFFF if unknown
+    std::uint8_t  Reserved2[12];
+    std::uint32_t TrailSignature; // 0xAA550000
+};
+
 struct DirectoryEntry
 {
     std::uint8_t  Name[8];
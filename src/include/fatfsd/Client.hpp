@@ -0,0 +1,47 @@
+#pragma once
+
+#include "fatfs/FileAllocationTable.hpp"
+#include "fatfsd/Protocol.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace Fatfs::Daemon
+{
+// connection to a running fatfsd. calls block until the response arrives and
+// throw the same Fatfs::Errors exceptions a local FileAllocationTable would.
+// not safe for concurrent use; open one client per thread instead
+class Client
+{
+  public:
+    explicit Client(std::string_view socketPath);
+    ~Client();
+
+    Client(const Client &)            = delete;
+    Client &operator=(const Client &) = delete;
+
+    [[nodiscard]] std::vector<std::byte> ReadFile(std::string_view volume,
+                                                  std::string_view path);
+    [[nodiscard]] std::vector<FileInfo> ReadDirectory(std::string_view volume,
+                                                      std::string_view path);
+    [[nodiscard]] FileInfo Stat(std::string_view volume, std::string_view path);
+
+    void CreateFile(std::string_view           volume,
+                    std::string_view           path,
+                    std::span<const std::byte> data);
+    void CreateDirectory(std::string_view volume, std::string_view path);
+
+  private:
+    std::vector<std::byte> Call(Opcode                     op,
+                                std::string_view           volume,
+                                std::string_view           path,
+                                std::span<const std::byte> data = {});
+
+    int           fd_ = -1;
+    std::uint32_t nextId_{};
+};
+} // namespace Fatfs::Daemon
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "fatfs/FileAllocationTable.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// wire format shared by fatfsd and its clients. every message is a frame: a
+// 32-bit length followed by that many bytes. integers are little-endian,
+// strings and blobs are length-prefixed (16 and 32 bits respectively)
+//
+//   request:  u32 id, u8 opcode, str volume, str path, blob data
+//   response: u32 id, u8 status, blob payload
+//
+// a client may send several requests before reading the responses; they
+// come back in order, tagged with the id of their request
+namespace Fatfs::Daemon
+{
+enum class Opcode : std::uint8_t
+{
+    ReadFile = 1,    // payload: file contents
+    ReadDirectory,   // payload: u32 count, then that many FileInfo records
+    Stat,            // payload: one FileInfo record
+    CreateFile,      // data: file contents
+    CreateDirectory,
+};
+
+enum class Status : std::uint8_t
+{
+    Ok,
+    FileNotFound,
+    DirectoryNotFound,
+    FileAlreadyExists,
+    InvalidPath,
+    InvalidFileOperation,
+    FileSystemError, // payload: message
+    BadRequest,      // payload: message
+};
+
+struct Request
+{
+    std::uint32_t          Id{};
+    Opcode                 Op{};
+    std::string            Volume;
+    std::string            Path;
+    std::vector<std::byte> Data;
+};
+
+struct Response
+{
+    std::uint32_t          Id{};
+    Status                 Result{};
+    std::vector<std::byte> Payload;
+};
+
+class ProtocolError : public std::runtime_error
+{
+  public:
+    ProtocolError(const std::string &whatArg)
+        : std::runtime_error{whatArg}
+    {
+    }
+};
+
+constexpr std::size_t kMaxFrameSize = 256 * 1024 * 1024;
+// largest payload that fits a response frame, after id, status and length
+constexpr std::size_t kMaxPayloadSize = kMaxFrameSize - 9;
+
+[[nodiscard]] std::vector<std::byte> EncodeRequest(const Request &request);
+[[nodiscard]] Request DecodeRequest(std::span<const std::byte> frame);
+
+[[nodiscard]] std::vector<std::byte> EncodeResponse(const Response &response);
+[[nodiscard]] Response DecodeResponse(std::span<const std::byte> frame);
+
+// FileInfo record: str name, u8 is directory, u32 size, then creation, last
+// modification and last access as i64 Unix times
+void EncodeFileInfo(std::vector<std::byte> &out, const FileInfo &info);
+[[nodiscard]] FileInfo DecodeFileInfo(std::span<const std::byte> payload);
+[[nodiscard]] std::vector<FileInfo>
+DecodeFileInfos(std::span<const std::byte> payload);
+
+// blocking frame I/O on a connected stream socket; ReceiveFrame returns
+// false if the peer closed the connection between frames
+void SendFrame(int fd, std::span<const std::byte> frame);
+bool ReceiveFrame(int fd, std::vector<std::byte> &frame);
+} // namespace Fatfs::Daemon
@@ -9,7 +9,8 @@ namespace Utilities
 
 namespace String
 {
-std::string TrimString(std::string_view str);
+std::string      TrimString(std::string_view str);
+std::string_view TrimStringView(std::string_view str);
 };
 
 } // namespace Utilities
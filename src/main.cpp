@@ -2,121 +2,726 @@
 #include "fatfs/FileAllocationTable.hpp"
 #include "fatfs/Structures.hpp"
 
+#include <algorithm>
+#include <cctype>
 #include <cstddef>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <limits>
+#include <map>
+#include <optional>
 #include <stdexcept>
 #include <string>
+#include <vector>
 
-void Run(const std::vector<std::string> &args);
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
-int main(const int argc, char *argv[])
+int  Run(const std::vector<std::string> &args, Fatfs::MountOptions options);
+int  RunBatch(const Fatfs::FileAllocationTable &imp, std::istream &in);
+void Execute(const Fatfs::FileAllocationTable &imp,
+             const std::vector<std::string>   &args,
+             std::ostream                     &out);
+
+std::vector<std::string> Tokenize(const std::string &line);
+
+std::size_t ParseSize(const std::string &arg)
 {
-    const std::vector<std::string> args{argv, argv + argc};
+    std::size_t end = 0;
 
-    if (args.size() < 3)
+    try
     {
-        std::cerr << "usage: " << args[0]
-            << " <volume> <read|view|write> <args...>" << std::endl;
-        return 1;
+        const std::size_t size = std::stoull(arg, &end);
+        if (end == arg.size())
+            return size;
+    }
+    catch (const std::logic_error &)
+    {
+    }
+
+    throw std::runtime_error{"invalid size \"" + arg + "\""};
+}
+
+std::vector<std::byte> ToBytes(const std::string &arg)
+{
+    std::vector<std::byte> data;
+    data.reserve(arg.size());
+
+    for (const auto &c : arg)
+        data.push_back(static_cast<std::byte>(c));
+
+    return data;
+}
+
+// bytes left to read from fd if it is a regular file; pipes and terminals
+// don't know in advance
+std::optional<std::size_t> InputSize(int fd)
+{
+    struct stat status{};
+    if (::fstat(fd, &status) != 0 || !S_ISREG(status.st_mode))
+        return std::nullopt;
+
+    const off_t position = ::lseek(fd, 0, SEEK_CUR);
+    if (position < 0 || position > status.st_size)
+        return std::nullopt;
+
+    return status.st_size - position;
+}
+
+// one file per line: CRC-32C in hex, the SHA-256 if there is one, size and
+// path, separated by tabs
+void WriteManifest(std::ostream &out, const std::vector<Fatfs::FileChecksum> &checksums)
+{
+    for (const Fatfs::FileChecksum &checksum : checksums)
+    {
+        out << std::hex << std::setw(8) << std::setfill('0') << checksum.Crc32c
+            << std::dec << '\t';
+
+        if (!checksum.Sha256.empty())
+            out << checksum.Sha256 << '\t';
+
+        out << checksum.Size << '\t' << checksum.Path << '\n';
+    }
+}
+
+std::vector<Fatfs::FileChecksum> ReadManifest(std::istream &in)
+{
+    std::vector<Fatfs::FileChecksum> checksums;
+
+    std::string line;
+    while (std::getline(in, line))
+    {
+        if (line.empty())
+            continue;
+
+        std::vector<std::string> fields;
+        for (std::size_t start = 0, end = 0; end != std::string::npos;
+             start = end + 1)
+        {
+            // the path is last and may hold anything but a newline
+            end = fields.size() == 3 ? std::string::npos : line.find('\t', start);
+            fields.push_back(line.substr(start, end - start));
+        }
+
+        if (fields.size() < 3 || fields.size() > 4 || fields[0].size() != 8)
+            throw std::runtime_error{"invalid manifest line \"" + line + "\""};
+
+        Fatfs::FileChecksum &checksum = checksums.emplace_back();
+        checksum.Crc32c = std::stoul(fields[0], nullptr, 16);
+        checksum.Path   = fields.back();
+        checksum.Size   = ParseSize(fields[fields.size() - 2]);
+
+        if (fields.size() == 4)
+            checksum.Sha256 = fields[1];
     }
 
+    return checksums;
+}
+
+// runs function, printing any error it throws to stderr; returns the exit
+// code for it, or 0
+template<typename F>
+int Report(const std::string &prefix, F &&function)
+{
     try
     {
-        Run(args);
+        function();
     }
     catch (const Fatfs::Errors::InvalidFileOperationError &e)
     {
-        std::cerr << "invalid file operation error: " << e.what() << std::endl;
+        std::cerr << prefix << "invalid file operation error: " << e.what()
+                  << std::endl;
         return 3;
     }
     catch (const Fatfs::Errors::InvalidPathError &e)
     {
-        std::cerr << "invalid path error: " << e.what() << std::endl;
+        std::cerr << prefix << "invalid path error: " << e.what() << std::endl;
         return 3;
     }
     catch (const Fatfs::Errors::FileSystemError &e)
     {
-        std::cerr << "generic file system error: " << e.what() << std::endl;
+        std::cerr << prefix << "generic file system error: " << e.what()
+                  << std::endl;
         return 3;
     }
     catch (const std::runtime_error &e)
     {
-        std::cerr << "error: " << e.what() << std::endl;
+        std::cerr << prefix << "error: " << e.what() << std::endl;
         return 2;
     }
 
     return 0;
 }
 
-void Run(const std::vector<std::string> &args)
+int main(const int argc, char *argv[])
 {
-    const Fatfs::FileAllocationTable imp{args[1]};
+    std::vector<std::string> args{argv, argv + argc};
+    Fatfs::MountOptions      options{};
+
+    // "-j <journal>" in front of the volume enables the write-ahead journal
+    if (args.size() > 2 && args[1] == "-j")
+    {
+        options.JournalPath = args[2];
+        args.erase(args.begin() + 1, args.begin() + 3);
+    }
+
+    if (args.size() < 3)
+    {
+        std::cerr << "usage: " << args[0]
+            << " [-j <journal>] <volume> <read|view|find|checksum|du|df|create|append|write|truncate|preallocate|delete|erase|move|copy|compact|sync|check|batch> <args...>" << std::endl;
+        return 1;
+    }
+
+    int status = 0;
+    if (const int error = Report("", [&] { status = Run(args, options); }))
+        return error;
+
+    return status;
+}
+
+int Run(const std::vector<std::string> &args, Fatfs::MountOptions options)
+{
+    if (args[2] == "batch")
+    {
+        // with a journal, metadata is committed once at the end (or on
+        // "sync"), unless asked otherwise. without one, the FAT has to keep
+        // up with the directory entries and data written beside it, or an
+        // interrupted run would leave entries pointing at free clusters
+        if (!options.OperationsPerFlush && options.JournalPath)
+            options.OperationsPerFlush = std::numeric_limits<std::size_t>::max();
+
+        const Fatfs::FileAllocationTable imp{args[1], options};
+
+        int status = 0;
+        if (args.size() > 3)
+        {
+            std::ifstream script{args[3]};
+            if (!script.is_open())
+                throw std::runtime_error{"failed to open script " + args[3]};
+
+            status = RunBatch(imp, script);
+        }
+        else
+        {
+            status = RunBatch(imp, std::cin);
+        }
+
+        imp.Sync();
+        return status;
+    }
+
+    const Fatfs::FileAllocationTable imp{args[1], options};
+
+    Execute(imp, {args.begin() + 2, args.end()}, std::cout);
+    return 0;
+}
+
+int RunBatch(const Fatfs::FileAllocationTable &imp, std::istream &in)
+{
+    std::ios::sync_with_stdio(false);
+
+    std::string line;
+    std::size_t lineNumber = 0;
+    int         batchStatus = 0; // worst exit code of any command
+
+    while (std::getline(in, line))
+    {
+        lineNumber++;
+
+        const std::vector<std::string> command = Tokenize(line);
+        if (command.empty() || command[0].starts_with('#'))
+            continue;
+
+        // a failing command is reported and skipped; the rest still runs
+        const int status = Report(
+            "line " + std::to_string(lineNumber) + ": ",
+            [&]
+            {
+                // the file's contents would be the rest of the script
+                if (&in == &std::cin && command[0] == "create" &&
+                    command.size() > 2 && command[2] == "-")
+                {
+                    throw std::runtime_error{
+                        "\"create <file> -\" can't read stdin while the script "
+                        "comes from it"};
+                }
+
+                Execute(imp, command, std::cout);
+            });
+        batchStatus = std::max(batchStatus, status);
+    }
+
+    std::cout.flush();
+    return batchStatus;
+}
+
+std::vector<std::string> Tokenize(const std::string &line)
+{
+    std::vector<std::string> tokens;
+
+    for (std::size_t i = 0; i < line.size();)
+    {
+        if (std::isspace(static_cast<unsigned char>(line[i])))
+        {
+            i++;
+            continue;
+        }
+
+        std::string token;
+
+        if (line[i] == '"')
+        {
+            // quoted; "" stands for a literal quote
+            for (i++; i < line.size(); i++)
+            {
+                if (line[i] == '"' && i + 1 < line.size() && line[i + 1] == '"')
+                    token += line[i++];
+                else if (line[i] == '"')
+                    break;
+                else
+                    token += line[i];
+            }
+
+            i++; // closing quote
+        }
+        else
+        {
+            while (i < line.size() &&
+                   !std::isspace(static_cast<unsigned char>(line[i])))
+                token += line[i++];
+        }
+
+        tokens.push_back(std::move(token));
+    }
+
+    return tokens;
+}
+
+void Execute(const Fatfs::FileAllocationTable &imp,
+             const std::vector<std::string>   &args,
+             std::ostream                     &out)
+{
+    if (args[0] == "sync")
+    {
+        // "sync <host directory> <directory>" refreshes the directory from the
+        // host; without arguments, pending metadata is written
+        if (args.size() > 2)
+        {
+            const Fatfs::SyncReport report = imp.SyncFrom(args[1], args[2]);
+
+            for (const std::string &path : report.Skipped)
+                std::cerr << "skipped " << path << ": no valid 8.3 name" << std::endl;
+
+            out << report.Created << " created, " << report.Updated
+                << " updated, " << report.Deleted << " deleted, "
+                << report.Unchanged << " unchanged, " << report.Skipped.size()
+                << " skipped" << std::endl;
+            return;
+        }
+
+        imp.Sync();
+        return;
+    }
+
+    if (args[0] == "check")
+    {
+        // "-r" repairs what can be repaired
+        const Fatfs::CheckReport report =
+            imp.Check(args.size() > 1 && args[1] == "-r");
 
-    if (args.size() < 4)
+        for (const std::string &problem : report.Problems)
+            out << problem << '\n';
+        if (report.UnlistedProblems > 0)
+            out << "... and " << report.UnlistedProblems << " more\n";
+
+        out << report.Directories << " directories, " << report.Files
+            << " files; " << report.CrossLinkedClusters << " cross-linked, "
+            << report.Loops << " loops, " << report.BrokenChains
+            << " broken chains, " << report.SizeMismatches
+            << " size mismatches, " << report.LostChains << " lost chains ("
+            << report.LostClusters << " clusters), " << report.FatMismatches
+            << " FAT sector mismatches" << std::endl;
+
+        if (report.Repaired)
+            out << "repaired" << std::endl;
+        else if (!report.Clean())
+            throw Fatfs::Errors::FileSystemError{"volume is inconsistent"};
+
+        return;
+    }
+
+    if (args[0] == "df")
+    {
+        const Fatfs::VolumeUsage usage = imp.Usage();
+
+        out << "cluster size: " << usage.ClusterSize << '\n'
+            << "total:        " << usage.TotalClusters << " clusters, "
+            << usage.TotalClusters * usage.ClusterSize << " bytes\n"
+            << "used:         " << usage.UsedClusters << " clusters, "
+            << usage.UsedClusters * usage.ClusterSize << " bytes\n"
+            << "free:         " << usage.FreeClusters << " clusters, "
+            << usage.FreeClusters * usage.ClusterSize << " bytes\n"
+            << "bad:          " << usage.BadClusters << " clusters"
+            << std::endl;
+
+        return;
+    }
+
+    if (args.size() < 2)
     {
-        throw std::runtime_error{"missing argument for command \"" + args[2] +
+        throw std::runtime_error{"missing argument for command \"" + args[0] +
                                  "\""};
     }
 
-    if (args[3].find('/') != std::string::npos)
+    if (args[1].find('/') != std::string::npos)
     {
         throw Fatfs::Errors::InvalidPathError{
             "forward slash detected in file name; please use backslashes "
             "for separating directories"};
     }
 
-    if (args[2] == "read")
+    if (args[0] == "read")
     {
-        std::cout << reinterpret_cast<char *>(imp.ReadFile(args[3]).data());
+        // straight to the descriptor behind out, which is always std::cout;
+        // -o writes to a host file instead
+        if (args.size() > 3 && args[2] == "-o")
+        {
+            const int fd = ::open(args[3].c_str(),
+                                  O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                                  0644);
+            if (fd < 0)
+                throw std::runtime_error{"failed to open file " + args[3]};
+
+            try
+            {
+                imp.ReadFileTo(args[1], fd);
+            }
+            catch (...)
+            {
+                ::close(fd);
+                throw;
+            }
+
+            ::close(fd);
+            return;
+        }
+
+        out.flush();
+        imp.ReadFileTo(args[1], STDOUT_FILENO);
     }
-    else if (args[2] == "view")
+    else if (args[0] == "view")
     {
-        const std::vector<Fatfs::FileInfo> entries = imp.ReadDirectory(args[3]);
-
-        for (const auto &[name,
-                          creationTimestamp,
-                          lastModificationTimestamp,
-                          lastAccessDate, size,
-                          isDirectory] : entries)
+        // entries are printed as they are read
+        for (const Fatfs::DirectoryEntryView &entry : imp.IterateDirectory(args[1]))
         {
-            std::cout << "Name: " << name;
-            if (isDirectory)
-                std::cout << " (directory)";
+            const std::time_t creationTimestamp = entry.CreationTimestamp();
+            const std::time_t lastModificationTimestamp =
+                entry.LastModificationTimestamp();
+            const std::time_t lastAccessDate = entry.LastAccessDate();
+
+            out << "Name: " << entry.Name();
+            if (entry.IsDirectory())
+                out << " (directory)";
             else
-                std::cout << "\n  size: " << size << " bytes";
+                out << "\n  size: " << entry.Size() << " bytes";
 
-            std::cout << "\n  created: "
+            out << "\n  created: "
                 << std::ctime(&creationTimestamp);
-            std::cout << "  last modified: "
+            out << "  last modified: "
                 << std::ctime(&lastModificationTimestamp);
-            std::cout << "  last accessed: "
+            out << "  last accessed: "
                 << std::ctime(&lastAccessDate);
 
-            std::cout << std::endl;
+            out << '\n';
         }
     }
-    else if (args[2] == "create")
+    else if (args[0] == "checksum")
     {
-        if (args.size() < 5)
+        // "--sha256" adds the stronger hash, "-o" writes the manifest to a
+        // host file, "--verify" compares against one instead
+        bool                       sha256 = false;
+        std::optional<std::string> output;
+        std::optional<std::string> manifest;
+
+        for (std::size_t i = 2; i < args.size(); i++)
         {
-            throw std::runtime_error{"missing data for command \"" + args[2] +
-                                     " " + args[3] + "\""};
+            if (args[i] == "--sha256")
+                sha256 = true;
+            else if (args[i] == "-o" && i + 1 < args.size())
+                output = args[++i];
+            else if (args[i] == "--verify" && i + 1 < args.size())
+                manifest = args[++i];
+            else
+                throw std::runtime_error{"invalid option \"" + args[i] + "\""};
         }
 
-        // if args[3] is "-d", create a directory
-        if (args[3] == "-d")
+        if (!manifest)
         {
-            imp.CreateDirectory(args[4]);
+            const std::vector<Fatfs::FileChecksum> checksums =
+                imp.Checksum(args[1], sha256);
+
+            if (!output)
+            {
+                WriteManifest(out, checksums);
+                out.flush();
+                return;
+            }
+
+            std::ofstream file{*output};
+            if (!file.is_open())
+                throw std::runtime_error{"failed to open file " + *output};
+
+            WriteManifest(file, checksums);
             return;
         }
 
-        // convert args[4] to vector<std::byte>
-        std::vector<std::byte> data;
-        data.reserve(args[4].size());
+        std::ifstream file{*manifest};
+        if (!file.is_open())
+            throw std::runtime_error{"failed to open file " + *manifest};
+
+        std::map<std::string, Fatfs::FileChecksum> expected;
+        for (Fatfs::FileChecksum &checksum : ReadManifest(file))
+        {
+            sha256 = sha256 || !checksum.Sha256.empty();
+            expected[checksum.Path] = std::move(checksum);
+        }
+
+        std::size_t matching = 0;
+        std::size_t problems = 0;
+
+        for (const Fatfs::FileChecksum &actual : imp.Checksum(args[1], sha256))
+        {
+            const auto it = expected.find(actual.Path);
+
+            if (it == expected.end())
+            {
+                out << "new: " << actual.Path << '\n';
+                problems++;
+                continue;
+            }
+
+            const Fatfs::FileChecksum &wanted = it->second;
+
+            if (wanted.Size != actual.Size || wanted.Crc32c != actual.Crc32c ||
+                (!wanted.Sha256.empty() && wanted.Sha256 != actual.Sha256))
+            {
+                out << "changed: " << actual.Path << '\n';
+                problems++;
+            }
+            else
+            {
+                matching++;
+            }
+
+            expected.erase(it);
+        }
+
+        for (const auto &[path, checksum] : expected)
+        {
+            out << "missing: " << path << '\n';
+            problems++;
+        }
+
+        out << matching << " files match, " << problems << " differ"
+            << std::endl;
+
+        if (problems > 0)
+            throw Fatfs::Errors::FileSystemError{"volume does not match the manifest"};
+    }
+    else if (args[0] == "du")
+    {
+        // allocated bytes, file bytes and path, for every directory unless
+        // -s asks for the total only
+        const std::vector<Fatfs::DirectoryUsage> usage = imp.DiskUsage(args[1]);
+        const bool summary = args.size() > 2 && args[2] == "-s";
+
+        // the directory itself sorts in front of everything below it
+        for (const Fatfs::DirectoryUsage &directory : usage)
+        {
+            out << directory.AllocatedBytes << '\t' << directory.Bytes << '\t'
+                << directory.Path << '\n';
+
+            if (summary)
+                break;
+        }
+
+        out.flush();
+    }
+    else if (args[0] == "find")
+    {
+        if (args.size() < 3)
+        {
+            throw std::runtime_error{"missing pattern for command \"" +
+                                     args[0] + " " + args[1] + "\""};
+        }
+
+        Fatfs::FindOptions options{};
+        std::size_t        limit = std::numeric_limits<std::size_t>::max();
 
-        for (const auto &c : args[4])
-            data.push_back(static_cast<std::byte>(c));
+        for (std::size_t i = 3; i < args.size(); i++)
+        {
+            if (i + 1 == args.size())
+                throw std::runtime_error{"missing value for \"" + args[i] + "\""};
 
-        imp.CreateFile(args[3], data);
+            if (args[i] == "--type" && (args[i + 1] == "f" || args[i + 1] == "d"))
+            {
+                options.Type = args[i + 1] == "f" ? Fatfs::EntryType::File
+                                                  : Fatfs::EntryType::Directory;
+            }
+            else if (args[i] == "--min-size")
+                options.MinSize = ParseSize(args[i + 1]);
+            else if (args[i] == "--max-size")
+                options.MaxSize = ParseSize(args[i + 1]);
+            else if (args[i] == "--limit")
+                limit = ParseSize(args[i + 1]);
+            else
+                throw std::runtime_error{"invalid option \"" + args[i] + "\""};
+
+            i++;
+        }
+
+        if (limit == 0)
+            return;
+
+        // matches are printed as they are found
+        std::size_t found = 0;
+        imp.Find(args[1],
+                 args[2],
+                 options,
+                 [&](std::string_view path, const Fatfs::DirectoryEntryView &)
+                 {
+                     out << path << '\n';
+                     return ++found < limit;
+                 });
+    }
+    else if (args[0] == "create")
+    {
+        if (args.size() < 3)
+        {
+            throw std::runtime_error{"missing data for command \"" + args[0] +
+                                     " " + args[1] + "\""};
+        }
+
+        // if args[1] is "-d", create a directory
+        if (args[1] == "-d")
+        {
+            imp.CreateDirectory(args[2]);
+            return;
+        }
+
+        // "-" streams the contents from stdin, "--from" from a host file
+        if (args[2] == "-")
+        {
+            imp.CreateFile(args[1], std::cin, InputSize(STDIN_FILENO));
+            return;
+        }
+
+        if (args[2] == "--from")
+        {
+            if (args.size() < 4)
+            {
+                throw std::runtime_error{"missing host file for command \"" +
+                                         args[0] + " " + args[1] + "\""};
+            }
+
+            std::ifstream input{args[3], std::ios::binary};
+            if (!input.is_open())
+                throw std::runtime_error{"failed to open file " + args[3]};
+
+            const std::filesystem::path host{args[3]};
+            imp.CreateFile(args[1],
+                           input,
+                           std::filesystem::is_regular_file(host)
+                               ? std::optional{std::filesystem::file_size(host)}
+                               : std::nullopt);
+            return;
+        }
+
+        imp.CreateFile(args[1], ToBytes(args[2]));
+    }
+    else if (args[0] == "append" || args[0] == "truncate")
+    {
+        if (args.size() < 3)
+        {
+            throw std::runtime_error{"missing argument for command \"" +
+                                     args[0] + " " + args[1] + "\""};
+        }
+
+        if (args[0] == "append")
+            imp.Append(args[1], ToBytes(args[2]));
+        else
+            imp.Truncate(args[1], ParseSize(args[2]));
+    }
+    else if (args[0] == "preallocate")
+    {
+        // if args[1] is "-z", the file is grown to the reserved size
+        const bool zero = args[1] == "-z";
+        if (args.size() < (zero ? 4u : 3u))
+        {
+            throw std::runtime_error{"missing size for command \"" + args[0] +
+                                     " " + args[1] + "\""};
+        }
+
+        imp.Preallocate(zero ? args[2] : args[1],
+                        ParseSize(zero ? args[3] : args[2]),
+                        !zero);
+    }
+    else if (args[0] == "write")
+    {
+        if (args.size() < 4)
+        {
+            throw std::runtime_error{"missing offset or data for command \"" +
+                                     args[0] + " " + args[1] + "\""};
+        }
+
+        imp.Write(args[1], ParseSize(args[2]), ToBytes(args[3]));
+    }
+    else if (args[0] == "delete" || args[0] == "erase")
+    {
+        // if args[1] is "-r", remove a directory and everything in it
+        const bool recursive = args[1] == "-r";
+        if (recursive && args.size() < 3)
+        {
+            throw std::runtime_error{"missing path for command \"" + args[0] +
+                                     " -r\""};
+        }
+
+        const std::string &path = recursive ? args[2] : args[1];
+
+        if (args[0] == "delete")
+            imp.DeleteEntry(path, recursive);
+        else
+            imp.EraseEntry(path, recursive);
+    }
+    else if (args[0] == "move" || args[0] == "copy")
+    {
+        if (args.size() < 3)
+        {
+            throw std::runtime_error{"missing destination for command \"" +
+                                     args[0] + " " + args[1] + "\""};
+        }
+
+        if (args[2].find('/') != std::string::npos)
+        {
+            throw Fatfs::Errors::InvalidPathError{
+                "forward slash detected in file name; please use backslashes "
+                "for separating directories"};
+        }
+
+        if (args[0] == "move")
+            imp.Move(args[1], args[2]);
+        else
+            imp.Copy(args[1], args[2]);
+    }
+    else if (args[0] == "compact")
+    {
+        imp.CompactDirectory(args[1]);
+    }
+    else
+    {
+        throw std::runtime_error{"unknown command \"" + args[0] + "\""};
     }
 }
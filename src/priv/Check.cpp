@@ -0,0 +1,456 @@
+#include "fatfs/ClusterBitmap.hpp"
+#include "fatfs/Errors.hpp"
+#include "fatfs/FileAllocationTable.hpp"
+#include "fatfs/FileAllocationTable.impl.hpp"
+#include "fatfs/Helpers.hpp"
+#include "fatfs/Structures.hpp"
+#include "fatfs/WorkQueue.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+// problems beyond this are only counted, so a badly damaged volume doesn't
+// turn the report into a copy of the FAT
+constexpr std::size_t kMaxProblems = 1000;
+
+// repairs held at once; a volume with more is repaired in several passes
+constexpr std::size_t kRepairBatch = 64 * 1024;
+
+} // namespace
+
+// shared by the threads of a check
+struct Fatfs::FileAllocationTable::Implementation::CheckState
+{
+    // how to make an entry consistent again; applied after the walk
+    struct Repair
+    {
+        std::size_t EntryOffset{}; // 0 for the root directory, which has none
+        bool        IsDirectory{};
+        bool        CutChain{};
+        std::size_t LastCluster{}; // new end of the chain; 0 drops all of it
+        std::size_t Clusters{};    // left in the chain
+    };
+
+    explicit CheckState(std::size_t clusters)
+        : Used{clusters}
+    {
+    }
+
+    ClusterBitmap Used;
+
+    WorkQueue<PendingDirectory> Directories;
+
+    std::mutex          Mutex; // everything below
+    CheckReport         Report;
+    std::vector<Repair> Repairs;
+    bool                RepairsLeftOut{};
+
+    // under the mutex
+    void AddRepair(const Repair &repair)
+    {
+        if (Repairs.size() < kRepairBatch)
+            Repairs.push_back(repair);
+        else
+            RepairsLeftOut = true;
+    }
+
+    void AddProblem(std::size_t &counter, const std::string &problem)
+    {
+        const std::lock_guard lock{Mutex};
+
+        counter++;
+
+        if (Report.Problems.size() < kMaxProblems)
+            Report.Problems.push_back(problem);
+        else
+            Report.UnlistedProblems++;
+    }
+};
+
+Fatfs::CheckReport
+Fatfs::FileAllocationTable::Implementation::Check(bool repair)
+{
+    bool more = false;
+
+    const CheckReport report = CheckPass(repair, more);
+
+    // every pass fixes a full batch, so the problems run out
+    while (more)
+        static_cast<void>(CheckPass(true, more));
+
+    return report;
+}
+
+Fatfs::CheckReport
+Fatfs::FileAllocationTable::Implementation::CheckPass(bool repair, bool &more)
+{
+    more = false;
+
+    std::vector<Walker> walkers = PrepareWalkers();
+
+    CheckState state{fatEntryCount_};
+
+    // the root directory, which no FAT entry points to
+    if (version_ == FileSystemVersion::Fat32)
+    {
+        const std::size_t root = bpb_.Offset36.Fat32.FirstRootDirCluster;
+        const std::size_t clusters =
+            CheckChain(state, walkers.front().Reader, root, "\\", 0, true);
+
+        if (clusters > 0)
+            state.Directories.Push({root, clusters, ""});
+    }
+    else
+    {
+        state.Directories.Push({0, 0, ""});
+    }
+
+    state.Directories.Run(walkers.size(),
+                          [&](std::size_t thread, const PendingDirectory &directory)
+                          {
+                              CheckDirectory(state,
+                                             walkers[thread].Reader,
+                                             directory,
+                                             walkers[thread].Buffer);
+                          });
+
+    CheckReport &report = state.Report;
+
+    // allocated clusters no file reaches
+    const auto isLost = [&](std::size_t cluster, std::size_t next)
+    {
+        return next != 0 && !IsBadCluster(next) && !state.Used.Test(cluster);
+    };
+
+    std::size_t freeClusters = 0;
+    {
+        // a lost cluster no other lost cluster points to starts a lost chain
+        ClusterBitmap linked{fatEntryCount_};
+
+        for (std::size_t i = 2; i < fatEntryCount_; i++)
+        {
+            const std::size_t next = ExtractCluster(i);
+
+            if (next == 0)
+                freeClusters++;
+
+            if (isLost(i, next))
+            {
+                report.LostClusters++;
+
+                if (next >= 2 && next < fatEntryCount_)
+                    linked.TestAndSet(next);
+            }
+        }
+
+        for (std::size_t i = 2; report.LostClusters > 0 && i < fatEntryCount_; i++)
+        {
+            if (isLost(i, ExtractCluster(i)) && !linked.Test(i))
+            {
+                state.AddProblem(report.LostChains,
+                                 "lost chain starting at cluster " +
+                                     std::to_string(i));
+            }
+        }
+    }
+
+    if (freeClusterCount_ && *freeClusterCount_ != freeClusters)
+    {
+        report.FreeCountMismatch = true;
+        report.Problems.insert(report.Problems.begin(),
+                               "free cluster count is " +
+                                  std::to_string(*freeClusterCount_) +
+                                  ", counted " + std::to_string(freeClusters));
+    }
+
+    // copies that are supposed to mirror the active one
+    std::vector<std::size_t> differingSectors;
+    if (fatMirroring_ && bpb_.NumberOfFats > 1)
+    {
+        constexpr std::size_t kChunkSectors = 256;
+
+        const std::size_t sectorSize = bpb_.BytesPerSector;
+
+        std::vector<std::byte> active(kChunkSectors * sectorSize);
+        std::vector<std::byte> copy(kChunkSectors * sectorSize);
+
+        for (std::size_t first = 0; first < sectorsPerFat_; first += kChunkSectors)
+        {
+            const std::size_t sectors =
+                std::min(kChunkSectors, sectorsPerFat_ - first);
+
+            ReadVolume((firstFatSector_ + activeFat_ * sectorsPerFat_ + first) *
+                           sectorSize,
+                       active.data(),
+                       sectors * sectorSize);
+
+            for (std::size_t i = 0; i < bpb_.NumberOfFats; i++)
+            {
+                if (i == activeFat_)
+                    continue;
+
+                ReadVolume((firstFatSector_ + i * sectorsPerFat_ + first) *
+                               sectorSize,
+                           copy.data(),
+                           sectors * sectorSize);
+
+                for (std::size_t s = 0; s < sectors; s++)
+                {
+                    if (std::memcmp(active.data() + s * sectorSize,
+                                    copy.data() + s * sectorSize,
+                                    sectorSize) != 0)
+                    {
+                        state.AddProblem(report.FatMismatches,
+                                         "FAT copy " + std::to_string(i) +
+                                             " differs in sector " +
+                                             std::to_string(first + s));
+                        differingSectors.push_back(first + s);
+                    }
+                }
+            }
+        }
+    }
+
+    if (!repair || report.Clean())
+        return report;
+
+    // cut chains where they stopped being valid, and sizes to match
+    for (const CheckState::Repair &fix : state.Repairs)
+    {
+        if (fix.CutChain && fix.LastCluster != 0)
+            SetCluster(fix.LastCluster, endOfChainIndicator_);
+
+        // the FAT32 root directory has no entry to update
+        if (fix.EntryOffset == 0)
+            continue;
+
+        Structures::DirectoryEntry entry{};
+        ReadMetadata(fix.EntryOffset, &entry, sizeof entry);
+
+        if (fix.CutChain && fix.LastCluster == 0)
+        {
+            entry.FirstClusterHigh = 0;
+            entry.FirstClusterLow  = 0;
+
+            // a directory without clusters would read as the root directory
+            if (fix.IsDirectory)
+                entry.Name[0] = 0xE5;
+        }
+
+        if (!fix.IsDirectory)
+        {
+            entry.FileSize = std::min<std::size_t>(entry.FileSize,
+                                                   fix.Clusters * bytesPerCluster_);
+        }
+
+        WriteMetadata(fix.EntryOffset, &entry, sizeof entry);
+    }
+
+    // lost clusters hold nothing that can be attributed to a file anymore
+    for (std::size_t i = 2; report.LostClusters > 0 && i < fatEntryCount_; i++)
+    {
+        if (isLost(i, ExtractCluster(i)))
+            SetCluster(i, 0);
+    }
+
+    // rewrite every copy from the active one
+    for (const std::size_t sector : differingSectors)
+        dirtyFatSectors_[sector] = true;
+
+    if (fsInfoSector_ != 0)
+    {
+        freeClusterCount_ = CountFreeClusters();
+        fsInfoDirty_      = true;
+    }
+
+    // chains changed behind the caches' backs
+    extentMaps_.clear();
+    directorySlots_.clear();
+
+    Commit();
+
+    report.Repaired = true;
+    more            = state.RepairsLeftOut;
+
+    return report;
+}
+
+void Fatfs::FileAllocationTable::Implementation::CheckDirectory(
+    CheckState             &state,
+    FatReader              &reader,
+    const PendingDirectory &directory,
+    std::vector<std::byte> &buffer)
+{
+    using namespace Structures;
+
+    CheckReport &report = state.Report;
+    std::size_t  files  = 0;
+
+    ScanDirectory(
+        reader,
+        directory.FirstCluster,
+        directory.FirstCluster == 0 ? 1 : directory.Clusters,
+        buffer,
+        [&](const DirectoryEntry &entry, std::size_t offset)
+        {
+            const std::string path =
+                directory.Path + "\\" +
+                Helpers::Path::ConvertFatPathToLongPath(
+                    {reinterpret_cast<const char *>(entry.Name),
+                     std::size(entry.Name) + std::size(entry.Extension)});
+
+            const bool isDirectory =
+                (entry.Attributes & RawAttributes::Directory) != 0;
+            const std::size_t firstCluster =
+                entry.FirstClusterLow | entry.FirstClusterHigh << 16;
+
+            if (isDirectory && firstCluster == 0)
+            {
+                state.AddProblem(report.BrokenChains,
+                                 path + ": directory has no clusters");
+
+                const std::lock_guard lock{state.Mutex};
+                state.AddRepair({offset, true, true, 0, 0});
+                return true;
+            }
+
+            const std::size_t clusters =
+                firstCluster == 0
+                    ? 0
+                    : CheckChain(
+                          state, reader, firstCluster, path, offset, isDirectory);
+
+            if (isDirectory)
+            {
+                if (clusters > 0)
+                    state.Directories.Push({firstCluster, clusters, path});
+
+                return true;
+            }
+
+            files++;
+
+            // a chain longer than the size is fine; Preallocate leaves those
+            if (entry.FileSize > clusters * bytesPerCluster_)
+            {
+                state.AddProblem(report.SizeMismatches,
+                                 path + ": size " +
+                                     std::to_string(entry.FileSize) +
+                                     " is past the end of its " +
+                                     std::to_string(clusters) + " clusters");
+
+                const std::lock_guard lock{state.Mutex};
+                state.AddRepair({offset, false, false, 0, clusters});
+            }
+
+            return true;
+        });
+
+    const std::lock_guard lock{state.Mutex};
+    report.Directories++;
+    report.Files += files;
+}
+
+std::size_t Fatfs::FileAllocationTable::Implementation::CheckChain(
+    CheckState        &state,
+    FatReader         &reader,
+    std::size_t        firstCluster,
+    const std::string &path,
+    std::size_t        entryOffset,
+    bool               isDirectory)
+{
+    CheckReport &report = state.Report;
+
+    std::size_t cluster = firstCluster;
+    std::size_t last    = 0; // last valid cluster
+    std::size_t length  = 0;
+
+    const auto cut = [&](std::size_t &counter, const std::string &problem)
+    {
+        state.AddProblem(counter,
+                         path + ": " + problem + "; " + std::to_string(length) +
+                             " clusters are valid");
+
+        const std::lock_guard lock{state.Mutex};
+        state.AddRepair({entryOffset, isDirectory, true, last, length});
+    };
+
+    while (true)
+    {
+        if (cluster < 2 || cluster >= fatEntryCount_)
+        {
+            cut(report.BrokenChains,
+                "chain points to invalid cluster " + std::to_string(cluster));
+            break;
+        }
+
+        const std::size_t next = reader.Next(cluster);
+
+        if (next == 0)
+        {
+            cut(report.BrokenChains,
+                "chain runs into free cluster " + std::to_string(cluster));
+            break;
+        }
+
+        if (state.Used.TestAndSet(cluster))
+        {
+            // ours if it is among the clusters walked so far
+            bool loop = false;
+            for (std::size_t c = firstCluster, i = 0; i < length;
+                 i++, c = reader.Next(c))
+            {
+                if (c == cluster)
+                {
+                    loop = true;
+                    break;
+                }
+            }
+
+            if (loop)
+                cut(report.Loops,
+                    "chain loops back to cluster " + std::to_string(cluster));
+            else
+                cut(report.CrossLinkedClusters,
+                    "cluster " + std::to_string(cluster) +
+                        " also belongs to another chain");
+            break;
+        }
+
+        last = cluster;
+        length++;
+
+        // IsEndOfClusterChain takes the FAT12/FAT16 bad cluster marker for an
+        // end; a chain has no business pointing at it
+        if (IsBadCluster(next))
+        {
+            cut(report.BrokenChains,
+                "chain runs into a bad cluster after cluster " +
+                    std::to_string(cluster));
+            break;
+        }
+
+        if (IsEndOfClusterChain(next))
+            break;
+
+        cluster = next;
+    }
+
+    return length;
+}
+
+bool Fatfs::FileAllocationTable::Implementation::IsBadCluster(
+    std::size_t value) const
+{
+    return (version_ == FileSystemVersion::Fat12 && value == 0x0FF7) ||
+           (version_ == FileSystemVersion::Fat16 && value == 0xFFF7) ||
+           (version_ == FileSystemVersion::Fat32 && value == 0x0FFFFFF7);
+}
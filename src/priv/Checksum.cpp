@@ -0,0 +1,156 @@
+#include "fatfs/Errors.hpp"
+#include "fatfs/FileAllocationTable.hpp"
+#include "fatfs/FileAllocationTable.impl.hpp"
+#include "fatfs/Hash.hpp"
+#include "fatfs/Helpers.hpp"
+#include "fatfs/Structures.hpp"
+#include "fatfs/WorkQueue.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+struct PendingFile
+{
+    std::string Path;
+    std::size_t FirstCluster{};
+    std::size_t Size{};
+};
+
+// largest read of one run of contiguous clusters
+constexpr std::size_t kBlockSize = 1024 * 1024;
+
+} // namespace
+
+std::vector<Fatfs::FileChecksum>
+Fatfs::FileAllocationTable::Implementation::Checksum(std::string_view directory,
+                                                     bool             sha256)
+{
+    using namespace Structures;
+
+    std::vector<Walker> walkers = PrepareWalkers();
+
+    std::mutex               filesMutex;
+    std::vector<PendingFile> files;
+
+    // first the list of files, from the directories alone
+    WalkTree(
+        walkers,
+        directory,
+        [&](Walker &walker, const PendingDirectory &pending, const auto &descend)
+        {
+            ScanDirectory(
+                walker.Reader,
+                pending.FirstCluster,
+                fatEntryCount_,
+                walker.Buffer,
+                [&](const DirectoryEntry &entry, std::size_t)
+                {
+                    if ((entry.Attributes & RawAttributes::Directory) != 0)
+                    {
+                        descend(entry);
+                        return true;
+                    }
+
+                    const std::string path =
+                        pending.Path + "\\" +
+                        Helpers::Path::ConvertFatPathToLongPath(
+                            {reinterpret_cast<const char *>(entry.Name),
+                             std::size(entry.Name) + std::size(entry.Extension)});
+
+                    const std::size_t firstCluster =
+                        entry.FirstClusterLow | entry.FirstClusterHigh << 16;
+
+                    const std::lock_guard lock{filesMutex};
+                    files.push_back({path, firstCluster, entry.FileSize});
+                    return true;
+                });
+
+            return true;
+        });
+
+    // then their contents; the queue hands out the last item first, so
+    // sorting by size starts the largest files early instead of leaving one
+    // of them to run alone at the end
+    std::sort(files.begin(),
+              files.end(),
+              [](const PendingFile &a, const PendingFile &b)
+              { return a.Size < b.Size; });
+
+    std::vector<FileChecksum> checksums(files.size());
+
+    WorkQueue<std::size_t> hashes;
+    for (std::size_t i = 0; i < files.size(); i++)
+        hashes.Push(i);
+
+    hashes.Run(
+        walkers.size(),
+        [&](std::size_t thread, std::size_t index)
+        {
+            const PendingFile      &file   = files[index];
+            FatReader              &reader = walkers[thread].Reader;
+            std::vector<std::byte> &block  = walkers[thread].Buffer;
+
+            Hash::Crc32c crc32c;
+            Hash::Sha256 strong;
+
+            block.resize(kBlockSize);
+
+            std::size_t cluster = file.FirstCluster;
+            std::size_t left    = file.Size;
+
+            while (left > 0)
+            {
+                if (cluster < 2 || cluster >= fatEntryCount_)
+                {
+                    throw Errors::FileSystemError{
+                        file.Path + ": cluster chain is shorter than the file"};
+                }
+
+                // as many contiguous clusters as the block holds, in one read
+                std::size_t clusters = 1;
+                std::size_t next     = reader.Next(cluster);
+
+                while (next == cluster + clusters &&
+                       clusters * bytesPerCluster_ < std::min(left, kBlockSize))
+                {
+                    clusters++;
+                    next = reader.Next(next);
+                }
+
+                const std::size_t count =
+                    std::min(left, clusters * bytesPerCluster_);
+
+                ReadVolume(ConvertClusterToSector(cluster) * bpb_.BytesPerSector,
+                           block.data(),
+                           count);
+
+                crc32c.Update({block.data(), count});
+                if (sha256)
+                    strong.Update({block.data(), count});
+
+                left -= count;
+                cluster = IsEndOfClusterChain(next) ? 0 : next;
+            }
+
+            FileChecksum &checksum = checksums[index];
+            checksum.Path   = file.Path;
+            checksum.Size   = file.Size;
+            checksum.Crc32c = crc32c.Value();
+
+            if (sha256)
+                checksum.Sha256 = strong.Finish();
+        });
+
+    std::sort(checksums.begin(),
+              checksums.end(),
+              [](const FileChecksum &a, const FileChecksum &b)
+              { return a.Path < b.Path; });
+
+    return checksums;
+}
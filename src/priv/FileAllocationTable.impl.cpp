@@ -3,47 +3,159 @@
 #include "fatfs/FileAllocationTable.impl.hpp"
 #include "fatfs/Helpers.hpp"
 #include "fatfs/Structures.hpp"
+#include "fatfs/WorkQueue.hpp"
 
 #include "utilities/String.hpp"
 
 #include <algorithm>
+#include <array>
+#include <cerrno>
 #include <chrono>
 #include <concepts>
+#include <cstddef>
 #include <cstdint>
 #include <cstring>
+#include <functional>
+#include <future>
+#include <istream>
 #include <iterator>
-#include <sstream>
+#include <string>
 #include <string_view>
 #include <vector>
 
+#include <fcntl.h>
+#include <sys/sendfile.h>
+#include <unistd.h>
+
 namespace
 {
 
-template<typename T>
-concept Integral = std::is_integral_v<T> || std::is_enum_v<T>;
+template<Fatfs::Integral T, Fatfs::Integral U = T>
+constexpr bool IsBitSet(const T seq, const U bit)
+{
+    return (seq & bit) == bit;
+}
 
-template<Integral T, Integral U = T>
-constexpr auto RoundUp(const T num, const U multiple)
+// false for deleted slots, long name fragments and the volume label
+bool IsVisibleEntry(const Fatfs::Structures::DirectoryEntry &entry)
 {
-    return (num + multiple - 1) / multiple * multiple;
+    using namespace Fatfs::Structures;
+
+    return entry.Name[0] != 0xE5 &&
+           (entry.Attributes & RawAttributes::LongName) !=
+               RawAttributes::LongName &&
+           !IsBitSet(entry.Attributes, RawAttributes::VolumeId);
 }
 
-template<Integral T, Integral U = T>
-constexpr bool IsBitSet(const T seq, const U bit)
+Fatfs::FileInfo MakeFileInfo(const Fatfs::Structures::DirectoryEntry &x,
+                             const Fatfs::Helpers::Time::EntryTimes &times)
 {
-    return (seq & bit) == bit;
+    using namespace Fatfs;
+
+    FileInfo fi{};
+    fi.Name = Helpers::Path::ConvertFatPathToLongPath(
+        {reinterpret_cast<const char *>(x.Name),
+         std::size(x.Name) + std::size(x.Extension)});
+
+    fi.CreationTimestamp         = times.Creation;
+    fi.LastModificationTimestamp = times.LastModification;
+    fi.LastAccessDate            = times.LastAccess;
+
+    fi.Size = x.FileSize;
+
+    fi.IsDirectory = IsBitSet(x.Attributes, Structures::RawAttributes::Directory);
+
+    return fi;
+}
+
+void WriteAll(int fd, const std::byte *data, std::size_t size)
+{
+    while (size > 0)
+    {
+        const ssize_t written = ::write(fd, data, size);
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written < 0)
+            throw std::runtime_error{std::string{"failed to write output: "} +
+                                     std::strerror(errno)};
+
+        data += written;
+        size -= written;
+    }
+}
+
+// errors that mean "this kind of copy is not possible between these two
+// descriptors", as opposed to the copy itself failing
+bool IsUnsupportedCopy(int error)
+{
+    return error == EINVAL || error == EXDEV || error == ENOSYS ||
+           error == EOPNOTSUPP || error == EBADF;
+}
+
+// copies size bytes at offset of in to out inside the kernel: copy_file_range
+// between regular files (which may share blocks instead of copying them),
+// sendfile to pipes and sockets. false if neither works for out, in which case
+// nothing has been written
+bool CopyInKernel(int in, int out, off_t offset, std::size_t size)
+{
+    bool first         = true;
+    bool copyFileRange = true;
+
+    while (size > 0)
+    {
+        const ssize_t copied =
+            copyFileRange ? ::copy_file_range(in, &offset, out, nullptr, size, 0)
+                          : ::sendfile(out, in, &offset, size);
+
+        if (copied < 0 && errno == EINTR)
+            continue;
+        if (copied < 0 && first && IsUnsupportedCopy(errno))
+        {
+            if (!copyFileRange)
+                return false;
+
+            copyFileRange = false;
+            continue;
+        }
+        if (copied < 0)
+            throw std::runtime_error{std::string{"failed to write output: "} +
+                                     std::strerror(errno)};
+        if (copied == 0)
+            throw Fatfs::Errors::FileSystemError{"unexpected end of volume"};
+
+        first = false;
+        size -= copied;
+    }
+
+    return true;
 }
 
 } // namespace
 
 Fatfs::FileAllocationTable::Implementation::Implementation(
-    const std::string_view path)
+    const std::string_view path,
+    const MountOptions    &options)
     : bpb_()
 {
+    utcOffset_  = options.UtcOffset.value_or(Helpers::Time::LocalUtcOffset());
+    volumePath_ = path;
+
     fstream_.open(path.data(), std::ios::binary | std::ios::in | std::ios::out);
     if (!fstream_.is_open())
         throw std::runtime_error{"failed to open file " + std::string{path}};
 
+    // finish whatever an earlier session committed before looking at the
+    // volume
+    if (options.JournalPath)
+    {
+        journal_ = std::make_unique<Journal>(*options.JournalPath, path);
+        journal_->Replay(fstream_);
+    }
+
+    operationsPerFlush_ = std::max<std::size_t>(
+        options.OperationsPerFlush.value_or(journal_ ? 64 : 1),
+        1);
+
     // copy BPB to struct
     fstream_.seekg(0);
     fstream_.read(reinterpret_cast<char *>(&bpb_), sizeof bpb_);
@@ -76,574 +188,2171 @@ Fatfs::FileAllocationTable::Implementation::Implementation(
     else
         version_ = FileSystemVersion::Fat32;
 
-    // copy FAT table to struct
-    fat_.resize(sectorsInFatRegion_ * bpb_.BytesPerSector);
+    // FAT32 may disable mirroring, in which case only the active FAT copy is
+    // kept up to date; otherwise every copy mirrors the first one
+    if (version_ == FileSystemVersion::Fat32 &&
+        IsBitSet(bpb_.Offset36.Fat32.ExtendedFlags, 0x80))
+    {
+        fatMirroring_ = false;
+        activeFat_    = bpb_.Offset36.Fat32.ExtendedFlags & 0x0F;
+    }
+
+    const std::size_t bitsPerEntry = version_ == FileSystemVersion::Fat12 ? 12
+                                   : version_ == FileSystemVersion::Fat16 ? 16
+                                                                          : 32;
+    fatEntryCount_ =
+        std::min(totalDevClusters_ + 2,
+                 sectorsPerFat_ * bpb_.BytesPerSector * 8 / bitsPerEntry);
+
+    dirtyFatSectors_.assign(sectorsPerFat_, false);
+
+    // FAT12 tables are tiny, so they are always loaded in full
+    fatPaged_ = version_ != FileSystemVersion::Fat12 &&
+                sectorsPerFat_ > options.FatCacheSectors;
+
+    if (fatPaged_)
+    {
+        maxFatPages_ =
+            std::max<std::size_t>(options.FatCacheSectors / kFatPageSectors, 1);
+    }
+    else
+    {
+        // copy active FAT to struct
+        fat_.resize(sectorsPerFat_ * bpb_.BytesPerSector);
+
+        fstream_.seekg((firstFatSector_ + activeFat_ * sectorsPerFat_) *
+                       bpb_.BytesPerSector);
+        fstream_.read(reinterpret_cast<char *>(fat_.data()), fat_.size());
+    }
+
+    if (version_ == FileSystemVersion::Fat12)
+    {
+        // unpack FAT12 entries once so that chain walks are plain array
+        // loads; the packed copy in fat_ is only touched again on flush
+        fat12_.resize(fatEntryCount_);
+
+        for (std::size_t i = 0; i < fatEntryCount_; i++)
+        {
+            const std::size_t offset = i * 3 / 2;
+            const auto lo = std::to_integer<std::uint16_t>(fat_[offset]);
+            const auto hi = std::to_integer<std::uint16_t>(fat_[offset + 1]);
+            const std::uint16_t packed = lo | hi << 8;
 
-    fstream_.seekg(firstFatSector_ * bpb_.BytesPerSector);
-    fstream_.read(reinterpret_cast<char *>(fat_.data()), fat_.size());
+            fat12_[i] = i % 2 == 0 ? packed & 0x0FFF : packed >> 4;
+        }
+    }
 
     endOfChainIndicator_ =
         ExtractCluster(1); // end of chain marker is stored in the
     // second entry of the FAT table
 
     if (version_ == FileSystemVersion::Fat32)
+        ReadFsInfo();
+}
+
+Fatfs::FileAllocationTable::Implementation::~Implementation()
+{
+    // destructors must not throw; a group that fails to commit here is lost
+    // as a whole, which the journal makes safe
+    try
+    {
+        Commit();
+    }
+    catch (...)
     {
-        endOfChainIndicator_ &=
-            0x0FFFFFFF; // some weird software fills the upper 4
-        // bits, so we need to mask them out
     }
+
+    if (volumeFd_ >= 0)
+        ::close(volumeFd_);
 }
 
 std::vector<Fatfs::FileInfo>
 Fatfs::FileAllocationTable::Implementation::ReadDirectory(
     const std::string_view path)
 {
-    std::vector<FileInfo>                   dir{}; // user-readable directory
-    std::vector<Structures::DirectoryEntry> rawDir =
-        ReadRawDirectory(path); // "raw" directory (as it is on disk)
-
-    // convert to user-readable directory
-    std::transform(
-        rawDir.begin(),
-        rawDir.end(),
-        std::back_inserter(dir),
-        [&](const Structures::DirectoryEntry &x)
-        {
-            // convert name and extension to "normal" format
-            const std::string filename =
-                // 8 characters for name
-                std::string(reinterpret_cast<const char *>(x.Name),
-                            std::size(x.Name)) +
-                // 3 characters for extension
-                // 3 characters for extension
-                std::string(reinterpret_cast<const char *>(x.Extension),
-                            std::size(x.Extension));
-
-            auto toTimeT = std::chrono::system_clock::to_time_t;
-
-            FileInfo fi{};
-            fi.Name = Helpers::Path::ConvertFatPathToLongPath(filename);
-
-            fi.CreationTimestamp = toTimeT(
-                Helpers::Time::ConvertFatTimeToUnixTime(x.CreationTime,
-                                                        x.CreationDate));
-            fi.LastModificationTimestamp =
-                toTimeT(Helpers::Time::ConvertFatTimeToUnixTime(
-                    x.LastModificationTime,
-                    x.LastModificationDate));
-
-            fi.LastAccessDate = toTimeT(
-                Helpers::Time::ConvertFatTimeToUnixTime({}, x.LastAccessDate));
-
-            fi.Size = x.FileSize;
-
-            fi.IsDirectory =
-                IsBitSet(x.Attributes, Structures::RawAttributes::Directory);
-
-            return fi;
-        });
+    std::vector<FileInfo>                  dir{}; // user-readable directory
+    std::vector<Helpers::Time::EntryTimes> times{};
+
+    DirectoryCursor cursor = OpenDirectory(path);
+    ListDirectory(cursor, dir, times);
 
     return dir;
 }
 
-std::vector<std::byte> Fatfs::FileAllocationTable::Implementation::ReadFile(
-    const std::string_view path)
+std::pmr::vector<Fatfs::FileInfo>
+Fatfs::FileAllocationTable::Implementation::ReadDirectory(
+    std::string_view           path,
+    std::pmr::memory_resource *resource)
 {
-    return ReadFile(path, false);
+    std::pmr::vector<FileInfo>                  dir{resource};
+    std::pmr::vector<Helpers::Time::EntryTimes> times{resource};
+
+    DirectoryCursor cursor{.Buffer = std::pmr::vector<std::byte>{resource}};
+    ReopenDirectory(cursor, path);
+    ListDirectory(cursor, dir, times);
+
+    return dir;
 }
 
-std::vector<std::byte> Fatfs::FileAllocationTable::Implementation::ReadFile(
-    const std::string_view path,
-    const bool             isDirectory)
+std::span<const Fatfs::FileInfo>
+Fatfs::FileAllocationTable::Implementation::ReadDirectory(
+    std::string_view      path,
+    ReadContext::Buffers &context)
 {
-    std::string newPath = Utilities::String::TrimString(path);
-    if (newPath.empty())
-        throw Errors::InvalidPathError{"path is empty"};
+    // clearing keeps the capacity, and 8.3 names fit std::string's own
+    // storage, so refilling the listing allocates nothing
+    context.Listing.clear();
 
-    const std::vector<std::string> pathComponents =
-        Helpers::Path::SplitLongPathToFatComponents(newPath);
+    AttachReader(context);
+    ReopenDirectory(context.Cursor, path);
+    ListDirectory(context.Cursor, context.Listing, context.Times);
 
-    std::vector<std::byte>                  contents{};
-    std::vector<Structures::DirectoryEntry> parent =
-        ReadRawDirectory("\\"); // read root directory
+    return context.Listing;
+}
 
-    for (std::size_t i = 0; i < pathComponents.size(); ++i)
+template<typename Listing, typename Times>
+void Fatfs::FileAllocationTable::Implementation::ListDirectory(
+    DirectoryCursor &cursor,
+    Listing         &listing,
+    Times           &times)
+{
+    // convert to user-readable directory, one cluster at a time
+    for (auto rawDir = ReadNextDirectoryCluster(cursor); !rawDir.empty();
+         rawDir      = ReadNextDirectoryCluster(cursor))
     {
-        const auto &component = pathComponents[i];
-
-        // find directory entry
-        auto entry = std::find_if(
-            parent.begin(),
-            parent.end(),
-            [&](const Structures::DirectoryEntry &dirEntry)
-            {
-                const bool hasSameName = // compare first 8 characters
-                    std::memcmp(component.data(), dirEntry.Name, 8) == 0;
-                const bool hasSameExtension = // compare last 3 characters
-                    std::memcmp(component.data() + 8, dirEntry.Extension, 3) ==
-                    0;
-
-                bool condition = hasSameName && hasSameExtension;
-
-                // if there are more path components, then this one must be a
-                // directory otherwise, if is_directory is true then this one
-                // must be a directory, else a file
-                if (i < pathComponents.size() - 1 || isDirectory)
-                    condition = condition &&
-                                IsBitSet(dirEntry.Attributes,
-                                         Structures::RawAttributes::Directory);
-
-                return condition;
-            });
-
-        if (entry == parent.end())
-        {
-            if (i < pathComponents.size() - 1 || isDirectory)
-            {
-                throw Errors::DirectoryNotFoundError{
-                    "directory '" +
-                    Helpers::Path::ConvertFatPathToLongPath(component) +
-                    "' not found"};
-            }
-            throw Errors::FileNotFoundError{
-                "file '" + Helpers::Path::ConvertFatPathToLongPath(component) +
-                "' not found"};
-        }
+        times.resize(rawDir.size());
+        Helpers::Time::ConvertDirectoryTimes(rawDir, times, utcOffset_);
 
-        // if entry is file and there are more path components, then
-        // throw exception
-        if (i < pathComponents.size() - 1 &&
-            !IsBitSet(entry->Attributes, Structures::RawAttributes::Directory))
+        for (std::size_t i = 0; i < rawDir.size(); i++)
         {
-            throw Errors::InvalidFileOperationError{
-                "file '" + Helpers::Path::ConvertFatPathToLongPath(component) +
-                "' is not a directory, trying to browse contents of it"};
+            if (IsVisibleEntry(rawDir[i]))
+                listing.emplace_back(MakeFileInfo(rawDir[i], times[i]));
         }
+    }
+}
 
-        std::size_t cluster = entry->FirstClusterLow | entry->FirstClusterHigh
-                                                           << 16;
-        std::size_t newSize = 0;
-
-        do
-        {
-            // seek to position of cluster in disk
-            fstream_.seekg(ConvertClusterToSector(cluster) *
-                           bpb_.BytesPerSector);
-
-            newSize += bytesPerCluster_;
-            contents.resize(newSize);
+Fatfs::FileInfo
+Fatfs::FileAllocationTable::Implementation::Stat(std::string_view path)
+{
+    const Structures::DirectoryEntry entry = FindEntry(path, false).Entry;
 
-            // read cluster
-            fstream_.read(reinterpret_cast<char *>(contents.data() + newSize -
-                                                   bytesPerCluster_),
-                          bytesPerCluster_);
+    Helpers::Time::EntryTimes times{};
+    Helpers::Time::ConvertDirectoryTimes({&entry, 1}, {&times, 1}, utcOffset_);
 
-            cluster = ExtractCluster(cluster);
-        } while (!IsEndOfClusterChain(cluster));
+    return MakeFileInfo(entry, times);
+}
 
-        // if there are more path components, then set parent to contents
-        if (i != pathComponents.size() - 1)
-        {
-            const std::byte *ptr = contents.data();
+std::vector<std::byte> Fatfs::FileAllocationTable::Implementation::ReadFile(
+    const std::string_view path)
+{
+    // files are read one run of contiguous clusters at a time
+    const Structures::DirectoryEntry entry = FindFile(path).Entry;
 
-            const std::size_t len =
-                contents.size() / sizeof(Structures::DirectoryEntry);
-            const auto ptrAddr = reinterpret_cast<std::uintptr_t>(ptr);
-            const auto arr =
-                reinterpret_cast<const Structures::DirectoryEntry *>(ptrAddr);
+    std::vector<std::byte> contents(entry.FileSize);
+    contents.resize(ReadAt(entry, 0, contents));
 
-            parent = std::vector(arr, arr + len);
+    return contents;
+}
 
-            // get iterator to first null entry
-            const auto kIterator =
-                std::find_if(parent.begin(),
-                             parent.end(),
-                             [](const Structures::DirectoryEntry &x)
-                             {
-                                 return x.Name[0] == '\0';
-                             });
+std::pmr::vector<std::byte> Fatfs::FileAllocationTable::Implementation::ReadFile(
+    std::string_view           path,
+    std::pmr::memory_resource *resource)
+{
+    DirectoryCursor cursor{.Buffer = std::pmr::vector<std::byte>{resource}};
 
-            // remove null entries
-            parent.erase(kIterator, parent.end());
-        }
+    const Structures::DirectoryEntry entry = FindFile(path, cursor).Entry;
 
-        // resize contents to actual size IF it is a file AND ONLY IF it is a
-        // file
-        if (i >= pathComponents.size() - 1 && !isDirectory)
-            contents = {contents.data(), contents.data() + entry->FileSize};
-    }
+    std::pmr::vector<std::byte> contents(entry.FileSize, resource);
+    contents.resize(ReadAt(entry, 0, contents));
 
     return contents;
 }
 
-void Fatfs::FileAllocationTable::Implementation::CreateFile(
-    std::string_view              path,
-    const std::vector<std::byte> &data)
+std::span<const std::byte> Fatfs::FileAllocationTable::Implementation::ReadFile(
+    std::string_view      path,
+    ReadContext::Buffers &context)
 {
-    std::size_t next =
-        GetNextFreeCluster(); // save first cluster as we're going to create
-                              // a new directory entry
-
-    CreateDirectoryEntry(path, data, false);
-
-    const std::size_t dataSizeInBytesRounded =
-        RoundUp(data.size(), bytesPerCluster_);
-    const std::size_t dataSizeInClusters =
-        dataSizeInBytesRounded / bytesPerCluster_;
+    AttachReader(context);
 
-    std::vector<std::vector<std::byte>> clusterDivision{}; // data divided into
-    // clusters
-    clusterDivision.reserve(dataSizeInClusters);
+    const Structures::DirectoryEntry entry = FindFile(path, context.Cursor).Entry;
 
-    for (std::size_t i = 0; i < dataSizeInClusters; i++)
-    {
-        std::vector<std::byte> cluster{};
-        cluster.reserve(bytesPerCluster_);
+    // within the capacity from earlier reads, resizing allocates nothing
+    context.Data.resize(entry.FileSize);
 
-        for (std::size_t j = 0; j < bytesPerCluster_; j++)
-        {
-            // copy normally until we run out of data, then we pad with 0s
-            if (i * bytesPerCluster_ + j < data.size())
-                cluster.emplace_back(data[i * bytesPerCluster_ + j]);
-            else
-                cluster.emplace_back(std::byte{0});
-        }
+    const std::size_t length =
+        context.Direct ? ReadDirect(entry, *context.Reader, context.Data)
+                       : ReadAt(entry, 0, context.Data);
 
-        clusterDivision.emplace_back(cluster);
-    }
+    return {context.Data.data(), length};
+}
 
-    // write FAT clusters
-    std::vector<std::size_t> savedClusters{};
-    savedClusters.reserve(dataSizeInClusters);
+Fatfs::FileInfo Fatfs::FileAllocationTable::Implementation::Stat(
+    std::string_view      path,
+    ReadContext::Buffers &context)
+{
+    AttachReader(context);
 
-    // write clusters to buffer
-    for (std::size_t i = 0; i < dataSizeInClusters; i++)
-    {
-        std::size_t current = next;
+    const Structures::DirectoryEntry entry =
+        FindEntry(path, false, context.Cursor).Entry;
 
-        // if we're at the last cluster, we need to set the end of chain marker
-        next = i < dataSizeInClusters - 1 ? GetNextFreeCluster(current)
-                                          : endOfChainIndicator_;
+    Helpers::Time::EntryTimes times{};
+    Helpers::Time::ConvertDirectoryTimes({&entry, 1}, {&times, 1}, utcOffset_);
 
-        SetCluster(current, next);
-        savedClusters.emplace_back(current);
-    }
+    return MakeFileInfo(entry, times);
+}
 
-    // write FAT
-    for (int i = 0; i < bpb_.NumberOfFats; i++)
+void Fatfs::FileAllocationTable::Implementation::AttachReader(
+    ReadContext::Buffers &context)
+{
+    if (!context.Direct)
     {
-        fstream_.seekp((firstFatSector_ + i * sectorsPerFat_) *
-                       bpb_.BytesPerSector);
-        fstream_.write(reinterpret_cast<const char *>(fat_.data()),
-                       sectorsPerFat_ * bpb_.BytesPerSector);
+        context.Cursor.Reader = nullptr;
+        return;
     }
 
-    // write data
-    for (int i = 0; i < savedClusters.size(); i++)
-    {
-        fstream_.seekp(ConvertClusterToSector(savedClusters[i]) *
-                       bpb_.BytesPerSector);
-        fstream_.write(
-            reinterpret_cast<const char *>(clusterDivision[i].data()),
-            bytesPerCluster_);
-    }
+    // a context may be used with more than one volume
+    if (!context.Reader || &context.Reader->Volume != this)
+        context.Reader.emplace(*this);
+
+    context.Cursor.Reader = &*context.Reader;
 }
 
-void Fatfs::FileAllocationTable::Implementation::CreateDirectory(
-    std::string_view path)
+std::size_t Fatfs::FileAllocationTable::Implementation::ReadDirect(
+    const Structures::DirectoryEntry &entry,
+    FatReader                        &reader,
+    std::span<std::byte>              buffer)
 {
-    std::size_t cluster =
-        GetNextFreeCluster(); // save first cluster as we're going to create
-                              // a new directory entry
+    std::size_t cluster = entry.FirstClusterLow | entry.FirstClusterHigh << 16;
+    std::size_t done    = 0;
 
-    CreateDirectoryEntry(path, {}, true);
-    SetCluster(cluster, endOfChainIndicator_);
+    const std::size_t length = std::min<std::size_t>(buffer.size(), entry.FileSize);
 
-    // write FAT
-    for (int i = 0; i < bpb_.NumberOfFats; i++)
+    // one read per run of contiguous clusters, stopping where the chain does
+    while (done < length && cluster >= 2 && cluster < fatEntryCount_)
     {
-        fstream_.seekp((firstFatSector_ + i * sectorsPerFat_) *
-                       bpb_.BytesPerSector);
-        fstream_.write(reinterpret_cast<const char *>(fat_.data()),
-                       sectorsPerFat_ * bpb_.BytesPerSector);
-    }
-
-    // create . and ..
-    auto [time, date] = Helpers::Time::ConvertUnixTimeToFatTime(
-        std::chrono::system_clock::now());
+        std::size_t clusters = 1;
+        std::size_t next     = reader.Next(cluster);
 
-    const std::size_t entriesPerCluster =
-        bytesPerCluster_ / sizeof(Structures::DirectoryEntry);
+        while (next == cluster + clusters && clusters * bytesPerCluster_ < length - done)
+        {
+            clusters++;
+            next = reader.Next(next);
+        }
 
-    std::vector<Structures::DirectoryEntry> entries(entriesPerCluster);
-    auto                                    entry1 = entries.begin();
+        const std::size_t count = std::min(length - done, clusters * bytesPerCluster_);
 
-    entry1->Name[0] = '.';
+        ReadVolume(ConvertClusterToSector(cluster) * bpb_.BytesPerSector,
+                   buffer.data() + done,
+                   count);
 
-    entry1->Attributes = Structures::RawAttributes::Directory;
+        done += count;
+        cluster = IsEndOfClusterChain(next) ? 0 : next;
+    }
 
-    // set fields
-    entry1->CreationDate         = date;
-    entry1->CreationTime         = time;
-    entry1->CreationTimeTenths   = 0;
-    entry1->LastAccessDate       = date;
-    entry1->FirstClusterHigh     = cluster >> 16; // high 16 bits
-    entry1->LastModificationTime = time;
-    entry1->LastModificationDate = date;
-    entry1->FirstClusterLow      = cluster & 0xFFFF; // low 16 bits
-    entry1->FileSize             = 0;
-
-    // no difference between . and .. except for first cluster
-    // get parent directory
-    std::vector<std::string> pathComponents =
-        Helpers::Path::SplitLongPathToFatComponents(path);
-    std::ostringstream oss{};
-    std::transform(pathComponents.begin(),
-                   pathComponents.end() - 1,
-                   std::ostream_iterator<std::string>(oss, "\\"),
-                   Helpers::Path::ConvertFatPathToLongPath);
-
-    const std::string                       parentDir = "\\" + oss.str();
-    std::vector<Structures::DirectoryEntry> parent =
-        ReadRawDirectory(parentDir);
-
-    // root directory does not contain . and .. entries
-    bool isParentRoot =
-        std::strncmp(reinterpret_cast<const char *>(parent[0].Name),
-                     ".          ",
-                     11) != 0;
-
-    auto entry2 = entries.begin() + 1;
-    // copy entry1 to entry2
-    std::memcpy(&*entry2, &*entry1, sizeof(Structures::DirectoryEntry));
-    entry2->Name[1]          = '.';
-    entry2->FirstClusterHigh = isParentRoot ? 0 : parent[0].FirstClusterHigh;
-    entry2->FirstClusterLow  = isParentRoot ? 0 : parent[0].FirstClusterLow;
+    return done;
+}
 
-    // write directory
-    fstream_.seekp(ConvertClusterToSector(cluster) * bpb_.BytesPerSector);
-    fstream_.write(reinterpret_cast<const char *>(entries.data()),
-                   bytesPerCluster_);
+std::size_t Fatfs::FileAllocationTable::Implementation::Read(
+    std::string_view     path,
+    std::size_t          offset,
+    std::span<std::byte> buffer)
+{
+    return ReadAt(FindFile(path).Entry, offset, buffer);
 }
 
-void Fatfs::FileAllocationTable::Implementation::DeleteEntry(
-    std::string_view path) const
+std::size_t
+Fatfs::FileAllocationTable::Implementation::FileSize(std::string_view path)
 {
+    return FindFile(path).Entry.FileSize;
 }
 
-void Fatfs::FileAllocationTable::Implementation::EraseEntry(
-    std::string_view path) const
+std::size_t Fatfs::FileAllocationTable::Implementation::ReadFileInto(
+    std::string_view     path,
+    std::span<std::byte> buffer)
 {
+    const Structures::DirectoryEntry entry = FindFile(path).Entry;
+
+    // a short buffer would silently cut the file; Read is there for parts
+    if (buffer.size() < entry.FileSize)
+    {
+        throw Errors::InvalidFileOperationError{
+            "buffer of " + std::to_string(buffer.size()) +
+            " bytes is too small for " + std::string{path} + " (" +
+            std::to_string(entry.FileSize) + " bytes)"};
+    }
+
+    return ReadAt(entry, 0, buffer);
 }
 
-Fatfs::FileSystemVersion
-Fatfs::FileAllocationTable::Implementation::Version() const
+std::size_t Fatfs::FileAllocationTable::Implementation::ReadAt(
+    const Structures::DirectoryEntry &entry,
+    std::size_t                       offset,
+    std::span<std::byte>              buffer)
 {
-    return version_;
+    const std::size_t firstCluster =
+        entry.FirstClusterLow | entry.FirstClusterHigh << 16;
+
+    if (firstCluster == 0 || offset >= entry.FileSize)
+        return 0;
+
+    const std::vector<Extent> &extents = GetExtentMap(firstCluster);
+
+    // never past the end of the chain, even if FileSize says otherwise
+    const std::size_t chainSize =
+        (extents.back().Index + extents.back().Length) * bytesPerCluster_;
+    const std::size_t length =
+        std::min({buffer.size(),
+                  std::size_t{entry.FileSize} - offset,
+                  chainSize > offset ? chainSize - offset : 0});
+
+    ForEachRun(extents,
+               offset,
+               length,
+               [&](std::size_t position, std::size_t done, std::size_t count)
+               {
+                   fstream_.seekg(position);
+                   fstream_.read(reinterpret_cast<char *>(buffer.data() + done),
+                                 count);
+               });
+
+    return length;
 }
 
-void Fatfs::FileAllocationTable::Implementation::CreateDirectoryEntry(
-    std::string_view              path,
-    const std::vector<std::byte> &data, // only if file
-    bool                          isDirectory)
+std::size_t Fatfs::FileAllocationTable::Implementation::ReadFileTo(
+    std::string_view path,
+    int              fd)
 {
-    std::string newPath = Utilities::String::TrimString(path);
-    if (newPath.empty())
-        throw Errors::InvalidPathError{"path is empty"};
+    const Structures::DirectoryEntry entry = FindFile(path).Entry;
+    const std::size_t                firstCluster =
+        entry.FirstClusterLow | entry.FirstClusterHigh << 16;
 
-    bool exists = true;
-    try
-    {
-        ReadFile(newPath, isDirectory);
-    }
-    catch (const Errors::FileNotFoundError &)
-    {
-        exists = false;
-    }
-    catch (const Errors::DirectoryNotFoundError &)
-    {
-        exists = false;
-    }
+    if (firstCluster == 0 || entry.FileSize == 0)
+        return 0;
 
-    if (exists)
-    {
-        if (isDirectory)
-            throw Errors::FileAlreadyExistsError{"directory " + newPath +
-                                                 " already exists"};
+    const std::vector<Extent> &extents = GetExtentMap(firstCluster);
+    const std::size_t          length  = std::min(
+        std::size_t{entry.FileSize},
+        (extents.back().Index + extents.back().Length) * bytesPerCluster_);
 
-        throw Errors::FileAlreadyExistsError{
-            "file " + newPath +
-            " already exists"}; // easy way out; we'll fix this later
-    }
+    // the kernel reads the volume through its own descriptor, so data still
+    // buffered in the stream has to reach it first
+    fstream_.flush();
 
-    // get parent directory
-    std::vector<std::string> pathComponents =
-        Helpers::Path::SplitLongPathToFatComponents(newPath);
-    std::ostringstream oss{};
-    // from first..(last - 1), convert each path to long path
-    std::transform(pathComponents.begin(),
-                   pathComponents.end() - 1,
-                   std::ostream_iterator<std::string>(oss, "\\"),
-                   Helpers::Path::ConvertFatPathToLongPath);
+    const int volumeFd = VolumeFd();
 
-    std::vector<Structures::DirectoryEntry> parent =
-        ReadRawDirectory("\\" + oss.str());
+    // runs this long are worth a system call of their own; shorter ones (a
+    // fragmented file) are gathered and written in large blocks
+    constexpr std::size_t kKernelCopyRun = 256 * 1024;
+    constexpr std::size_t kBufferSize    = 1024 * 1024;
 
-    const std::string &filename = pathComponents.back();
+    std::vector<std::byte> buffer;
+    std::size_t            buffered     = 0;
+    bool                   kernelCopies = true;
 
-    // DirectoryEntry::name[0] == 0x20 is illegal
-    if (filename[0] == ' ')
+    const auto flush = [&]
     {
-        throw Errors::InvalidPathError{
-            "first character of name shall not be 0x20 (or shall not start "
-            "with a period)"};
-    }
-
-    std::size_t next = GetNextFreeCluster();
+        WriteAll(fd, buffer.data(), buffered);
+        buffered = 0;
+    };
+
+    ForEachRun(
+        extents,
+        0,
+        length,
+        [&](std::size_t position, std::size_t, std::size_t count)
+        {
+            if (kernelCopies && count >= kKernelCopyRun)
+            {
+                flush();
 
-    auto [time, date] = Helpers::Time::ConvertUnixTimeToFatTime(
-        std::chrono::system_clock::now());
+                if (CopyInKernel(volumeFd, fd, position, count))
+                    return;
 
-    Structures::DirectoryEntry entry{};
+                // fd takes neither; fall back to plain writes for good
+                kernelCopies = false;
+            }
 
-    // copy filename
-    for (int i = 0; i < 8; i++)
-        entry.Name[i] = filename[i];
+            buffer.resize(kBufferSize);
 
-    // copy extension
-    for (int i = 0; i < 3; i++)
-        entry.Extension[i] = filename[i + 8];
+            while (count > 0)
+            {
+                if (buffered == kBufferSize)
+                    flush();
 
-    entry.Attributes = isDirectory ? Structures::RawAttributes::Directory
-                                   : Structures::RawAttributes::Archive;
+                const std::size_t chunk = std::min(count, kBufferSize - buffered);
+                fstream_.seekg(position);
+                fstream_.read(reinterpret_cast<char *>(buffer.data() + buffered),
+                              chunk);
 
-    // set fields
-    entry.CreationDate         = date;
-    entry.CreationTime         = time;
-    entry.CreationTimeTenths   = 0;
-    entry.LastAccessDate       = date;
-    entry.FirstClusterHigh     = (next & 0xFFFF0000) >> 16; // high 16 bits
-    entry.LastModificationTime = time;
-    entry.LastModificationDate = date;
-    entry.FirstClusterLow      = next & 0xFFFF; // low 16 bits
-    entry.FileSize             = isDirectory ? 0 : data.size();
+                buffered += chunk;
+                position += chunk;
+                count -= chunk;
+            }
+        });
 
-    const std::size_t oldDirSize = parent.size();
+    flush();
 
-    parent.emplace_back(entry);
+    return length;
+}
 
-    const std::size_t newDirSize =
-        parent.size(); // check if this one exceeds cluster boundary
+int Fatfs::FileAllocationTable::Implementation::VolumeFd()
+{
+    // a failed open leaves the flag unset, so the next call tries again
+    std::call_once(volumeFdOpened_,
+                   [this]
+                   {
+                       volumeFd_ = ::open(volumePath_.c_str(), O_RDONLY | O_CLOEXEC);
+                       if (volumeFd_ < 0)
+                           throw std::runtime_error{"failed to open file " +
+                                                    volumePath_};
+                   });
+
+    return volumeFd_;
+}
 
-    // get cluster of self
-    std::size_t selfCluster =
-        parent[0].Name[0] == '.'
-            ? parent[0].FirstClusterHigh << 16 | parent[0].FirstClusterLow
-            : 0; // if we're in the root directory, we don't have a cluster
+void Fatfs::FileAllocationTable::Implementation::ReadVolume(std::size_t offset,
+                                                            void       *data,
+                                                            std::size_t size)
+{
+    auto *bytes = static_cast<char *>(data);
 
-    // check if exceeding the maximum number of entries in a directory IF
-    // we're in the root directory and IF we're in a non-FAT32 volume
-    if (selfCluster == 0 && version_ != FileSystemVersion::Fat32)
+    while (size > 0)
     {
-        if (parent.size() > bpb_.RootDirEntries)
-        {
-            throw Errors::FileSystemError{"maximum number of entries in root "
-                                          "directory exceeded"};
-        }
+        const ssize_t count = ::pread(VolumeFd(), bytes, size, offset);
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count <= 0)
+            throw Errors::FileSystemError{"failed to read volume"};
+
+        bytes += count;
+        offset += count;
+        size -= count;
     }
+}
 
-    auto p = selfCluster;
-
-    // if root directory AND FAT32, get first cluster of root directory
-    if (selfCluster == 0 && version_ == FileSystemVersion::Fat32)
-        selfCluster = bpb_.Offset36.Fat32.FirstRootDirCluster;
+std::size_t Fatfs::FatReader::Next(std::size_t cluster)
+{
+    if (!Volume.fatPaged_)
+        return Volume.ExtractCluster(cluster);
 
-    // get sector from cluster
-    const std::size_t selfLba =
-        p == 0 ? firstRootDirSector_ : ConvertClusterToSector(selfCluster);
+    // FAT12 is never paged
+    const std::size_t entrySize =
+        Volume.version_ == FileSystemVersion::Fat16 ? 2 : 4;
+    const std::size_t offset = cluster * entrySize;
 
-    // only perform directory checks if either
-    //   - we're not in the root directory
-    //   - we're in the root directory, and we're in a FAT32 volume
-    if (p >= 2 || (p == 0 && version_ == FileSystemVersion::Fat32))
+    if (offset / kPageSize != PageIndex)
     {
-        std::vector<std::size_t> dirClusterChain =
-            ExtractClusterChain(selfCluster);
+        const std::size_t fatSize =
+            Volume.sectorsPerFat_ * Volume.bpb_.BytesPerSector;
+
+        PageIndex = offset / kPageSize;
+        Page.resize(std::min(kPageSize, fatSize - PageIndex * kPageSize));
+
+        Volume.ReadVolume((Volume.firstFatSector_ +
+                           Volume.activeFat_ * Volume.sectorsPerFat_) *
+                                  Volume.bpb_.BytesPerSector +
+                              PageIndex * kPageSize,
+                          Page.data(),
+                          Page.size());
+    }
 
-        const std::size_t entriesPerCluster =
-            bytesPerCluster_ / sizeof(Structures::DirectoryEntry);
+    const std::byte *entry = Page.data() + offset % kPageSize;
 
-        // if we're exceeding the cluster boundary, we need to allocate a new
-        // cluster
-        if (RoundUp(newDirSize, bytesPerCluster_) >
-            RoundUp(oldDirSize, bytesPerCluster_))
-        {
-            std::size_t newCluster = GetNextFreeCluster(selfCluster);
-            dirClusterChain.emplace_back(newCluster);
-            SetCluster(selfCluster, newCluster);
-            SetCluster(newCluster, endOfChainIndicator_);
-        }
+    if (entrySize == 2)
+    {
+        std::uint16_t value{};
+        std::memcpy(&value, entry, sizeof value);
+        return value;
+    }
 
-        const std::size_t newDirClusters =
-            RoundUp(newDirSize, bytesPerCluster_) / bytesPerCluster_;
+    std::uint32_t value{};
+    std::memcpy(&value, entry, sizeof value);
+    return value & 0x0FFFFFFF;
+}
 
-        // pad directory with 0s up until the next cluster boundary
-        parent.resize(entriesPerCluster * newDirClusters);
+std::vector<Fatfs::FileAllocationTable::Implementation::Walker>
+Fatfs::FileAllocationTable::Implementation::PrepareWalkers()
+{
+    // walkers read the volume directly, so it has to be up to date; the
+    // descriptor is opened before the threads share it
+    Commit();
+    static_cast<void>(VolumeFd());
 
-        int i = 0;
+    const std::size_t threadCount =
+        WorkQueue<PendingDirectory>::DefaultThreadCount();
 
-        // write directory
-        for (const auto &cluster : dirClusterChain)
-        {
-            fstream_.seekp(ConvertClusterToSector(cluster) *
-                           bpb_.BytesPerSector);
-            fstream_.write(reinterpret_cast<const char *>(
-                               parent.data() + i * entriesPerCluster),
-                           bytesPerCluster_);
-            i++;
-        }
-    }
-    else // we're in the root directory AND we're in a non-FAT32 volume
-    // AND (thankfully) we're not exceeding the maximum number of entries
-    {
-        parent.resize(bpb_.RootDirEntries);
+    std::vector<Walker> walkers;
+    walkers.reserve(threadCount);
 
-        // write directory
-        fstream_.seekp(selfLba * bpb_.BytesPerSector);
-        fstream_.write(reinterpret_cast<const char *>(parent.data()),
-                       parent.size() * sizeof(Structures::DirectoryEntry));
-    }
+    for (std::size_t i = 0; i < threadCount; i++)
+        walkers.emplace_back(*this);
+
+    return walkers;
 }
 
-std::size_t Fatfs::FileAllocationTable::Implementation::ExtractCluster(
-    size_t clusterNumber) const
+Fatfs::EntryLocation Fatfs::FileAllocationTable::Implementation::FindEntry(
+    const std::string_view path,
+    const bool             isDirectory)
 {
-    std::size_t cluster = clusterNumber;
-    auto        saFat   = reinterpret_cast<std::uintptr_t>(
-        fat_.data()); // to avoid strict aliasing
+    DirectoryCursor cursor{};
+    return FindEntry(path, isDirectory, cursor);
+}
 
-    switch (version_)
+Fatfs::EntryLocation Fatfs::FileAllocationTable::Implementation::FindEntry(
+    const std::string_view path,
+    const bool             isDirectory,
+    DirectoryCursor       &parent)
+{
+    if (Utilities::String::TrimStringView(path).empty())
+        throw Errors::InvalidPathError{"path is empty"};
+
+    const Helpers::Path::FatComponents pathComponents{path};
+
+    // the root directory has no entry of its own
+    EntryLocation location{};
+    location.Entry.Attributes = Structures::RawAttributes::Directory;
+
+    ReopenDirectory(parent, 0); // start at root directory
+
+    for (auto it = pathComponents.begin(); it != pathComponents.end();)
+    {
+        const auto &component = *it;
+
+        const auto next   = std::next(it);
+        const bool isLast = next == pathComponents.end();
+
+        // find directory entry, reading only as many clusters as needed
+        const Structures::DirectoryEntry *found = nullptr;
+        while (const Structures::DirectoryEntry *dirEntry =
+                   NextDirectoryEntry(parent))
+        {
+            const bool hasSameName = // compare first 8 characters
+                std::memcmp(component.data(), dirEntry->Name, 8) == 0;
+            const bool hasSameExtension = // compare last 3 characters
+                std::memcmp(component.data() + 8, dirEntry->Extension, 3) == 0;
+
+            bool condition = hasSameName && hasSameExtension;
+
+            // if there are more path components, then this one must be a
+            // directory otherwise, if is_directory is true then this one
+            // must be a directory, else a file
+            if (!isLast || isDirectory)
+                condition = condition &&
+                            IsBitSet(dirEntry->Attributes,
+                                     Structures::RawAttributes::Directory);
+
+            if (condition)
+            {
+                found = dirEntry;
+                break;
+            }
+        }
+
+        if (found == nullptr)
+        {
+            const std::string name = Helpers::Path::ConvertFatPathToLongPath(
+                {component.data(), component.size()});
+
+            if (!isLast || isDirectory)
+            {
+                throw Errors::DirectoryNotFoundError{"directory '" + name +
+                                                     "' not found"};
+            }
+            throw Errors::FileNotFoundError{"file '" + name + "' not found"};
+        }
+
+        // if entry is file and there are more path components, then
+        // throw exception
+        if (!isLast &&
+            !IsBitSet(found->Attributes, Structures::RawAttributes::Directory))
+        {
+            throw Errors::InvalidFileOperationError{
+                "file '" +
+                Helpers::Path::ConvertFatPathToLongPath(
+                    {component.data(), component.size()}) +
+                "' is not a directory, trying to browse contents of it"};
+        }
+
+        location.Entry  = *found;
+        location.Offset = GetEntryOffset(parent, found);
+        location.Parent = parent.FirstCluster;
+
+        // if there are more path components, descend into this one
+        if (!isLast)
+            ReopenDirectory(parent,
+                            location.Entry.FirstClusterLow |
+                                location.Entry.FirstClusterHigh << 16);
+
+        it = next;
+    }
+
+    return location;
+}
+
+std::size_t Fatfs::FileAllocationTable::Implementation::GetEntryOffset(
+    const DirectoryCursor            &cursor,
+    const Structures::DirectoryEntry *entry) const
+{
+    const std::size_t sector = cursor.Cluster == 0
+                                 ? firstRootDirSector_
+                                 : ConvertClusterToSector(cursor.Cluster);
+
+    return sector * bpb_.BytesPerSector +
+           static_cast<std::size_t>(
+               reinterpret_cast<const std::byte *>(entry) -
+               cursor.Buffer.data());
+}
+
+Fatfs::DirectoryCursor Fatfs::FileAllocationTable::Implementation::OpenDirectory(
+    const std::string_view path)
+{
+    DirectoryCursor cursor{};
+    ReopenDirectory(cursor, path);
+
+    return cursor;
+}
+
+Fatfs::DirectoryCursor Fatfs::FileAllocationTable::Implementation::OpenDirectory(
+    const std::size_t firstCluster)
+{
+    DirectoryCursor cursor{};
+    ReopenDirectory(cursor, firstCluster);
+
+    return cursor;
+}
+
+void Fatfs::FileAllocationTable::Implementation::ReopenDirectory(
+    DirectoryCursor       &cursor,
+    const std::string_view path)
+{
+    // if root path is given then open root directory
+    if (Helpers::Path::FatComponents{path}.empty())
+    {
+        ReopenDirectory(cursor, 0);
+        return;
+    }
+
+    const Structures::DirectoryEntry entry = FindEntry(path, true, cursor).Entry;
+
+    ReopenDirectory(cursor, entry.FirstClusterLow | entry.FirstClusterHigh << 16);
+}
+
+void Fatfs::FileAllocationTable::Implementation::ReopenDirectory(
+    DirectoryCursor  &cursor,
+    const std::size_t firstCluster)
+{
+    cursor.Cluster = firstCluster;
+
+    // cluster 0 stands for the root directory (e.g. in ".." entries), which
+    // only has a cluster chain in FAT32
+    if (firstCluster == 0 && version_ == FileSystemVersion::Fat32)
+        cursor.Cluster = bpb_.Offset36.Fat32.FirstRootDirCluster;
+
+    cursor.FirstCluster = cursor.Cluster;
+    cursor.Started      = false;
+    cursor.AtEnd        = false;
+    cursor.HitEndMarker = false;
+    cursor.Entries      = 0;
+    cursor.Index        = 0;
+}
+
+std::span<const Fatfs::Structures::DirectoryEntry>
+Fatfs::FileAllocationTable::Implementation::ReadNextDirectoryCluster(
+    DirectoryCursor &cursor)
+{
+    if (cursor.AtEnd)
+        return {};
+
+    if (cursor.Started)
+    {
+        // the FAT12/FAT16 root directory is read as a single block
+        if (cursor.Cluster == 0)
+        {
+            cursor.AtEnd = true;
+            return {};
+        }
+
+        cursor.Cluster = cursor.Reader != nullptr ? cursor.Reader->Next(cursor.Cluster)
+                                                  : ExtractCluster(cursor.Cluster);
+    }
+
+    cursor.Started = true;
+    cursor.Index   = 0;
+    cursor.Entries = 0;
+
+    if (cursor.Cluster != 0 &&
+        (cursor.Cluster < 2 || IsEndOfClusterChain(cursor.Cluster)))
+    {
+        cursor.AtEnd = true;
+        return {};
+    }
+
+    if (cursor.Cluster == 0)
+    {
+        // root directory in FAT12 and FAT16 has a fixed size and is located
+        // at a fixed offset (directly after the FAT table)
+        cursor.Buffer.resize(bpb_.RootDirEntries *
+                             sizeof(Structures::DirectoryEntry));
+    }
+    else
+    {
+        cursor.Buffer.resize(bytesPerCluster_);
+    }
+
+    if (cursor.Reader != nullptr)
+    {
+        ReadVolume(GetSlotOffset(cursor.Cluster, 0),
+                   cursor.Buffer.data(),
+                   cursor.Buffer.size());
+    }
+    else
+    {
+        ReadMetadata(GetSlotOffset(cursor.Cluster, 0),
+                     cursor.Buffer.data(),
+                     cursor.Buffer.size());
+    }
+
+    const auto *entries =
+        reinterpret_cast<const Structures::DirectoryEntry *>(
+            cursor.Buffer.data());
+    const std::size_t count =
+        cursor.Buffer.size() / sizeof(Structures::DirectoryEntry);
+
+    // get first null entry; nothing after it is in use
+    const auto *end = std::find_if(entries,
+                                   entries + count,
+                                   [](const Structures::DirectoryEntry &x)
+                                   {
+                                       return x.Name[0] == '\0';
+                                   });
+    if (end != entries + count)
+    {
+        cursor.AtEnd        = true;
+        cursor.HitEndMarker = true;
+    }
+
+    cursor.Entries = end - entries;
+
+    return {entries, cursor.Entries};
+}
+
+const Fatfs::Structures::DirectoryEntry *
+Fatfs::FileAllocationTable::Implementation::NextDirectoryEntry(
+    DirectoryCursor &cursor)
+{
+    while (true)
+    {
+        const auto *entries =
+            reinterpret_cast<const Structures::DirectoryEntry *>(
+                cursor.Buffer.data());
+
+        while (cursor.Index < cursor.Entries)
+        {
+            const Structures::DirectoryEntry *entry = entries + cursor.Index++;
+            if (IsVisibleEntry(*entry))
+                return entry;
+        }
+
+        if (ReadNextDirectoryCluster(cursor).empty())
+            return nullptr;
+    }
+}
+
+std::chrono::seconds Fatfs::FileAllocationTable::Implementation::UtcOffset() const
+{
+    return utcOffset_;
+}
+
+void Fatfs::FileAllocationTable::Implementation::CreateFile(
+    std::string_view              path,
+    const std::vector<std::byte> &data)
+{
+    const NewEntry newEntry = PrepareNewEntry(path, false);
+
+    const std::size_t dataSizeInBytesRounded =
+        RoundUp(data.size(), bytesPerCluster_);
+    const std::size_t dataSizeInClusters =
+        dataSizeInBytesRounded / bytesPerCluster_;
+
+    std::vector<std::vector<std::byte>> clusterDivision{}; // data divided into
+    // clusters
+    clusterDivision.reserve(dataSizeInClusters);
+
+    for (std::size_t i = 0; i < dataSizeInClusters; i++)
+    {
+        std::vector<std::byte> cluster{};
+        cluster.reserve(bytesPerCluster_);
+
+        for (std::size_t j = 0; j < bytesPerCluster_; j++)
+        {
+            // copy normally until we run out of data, then we pad with 0s
+            if (i * bytesPerCluster_ + j < data.size())
+                cluster.emplace_back(data[i * bytesPerCluster_ + j]);
+            else
+                cluster.emplace_back(std::byte{0});
+        }
+
+        clusterDivision.emplace_back(cluster);
+    }
+
+    // reserve the chain in the FAT before anything else allocates
+    const std::vector<std::size_t> savedClusters =
+        AllocateClusterChain(dataSizeInClusters);
+
+    // write data
+    for (std::size_t i = 0; i < savedClusters.size(); i++)
+    {
+        fstream_.seekp(ConvertClusterToSector(savedClusters[i]) *
+                       bpb_.BytesPerSector);
+        fstream_.write(
+            reinterpret_cast<const char *>(clusterDivision[i].data()),
+            bytesPerCluster_);
+    }
+
+    try
+    {
+        InsertDirectoryEntry(
+            newEntry.Parent,
+            MakeDirectoryEntry(newEntry.Name,
+                               Structures::RawAttributes::Archive,
+                               savedClusters.empty() ? 0 : savedClusters.front(),
+                               data.size()));
+    }
+    catch (...)
+    {
+        ReleaseClusters(savedClusters);
+        throw;
+    }
+
+    // write FAT
+    Flush();
+}
+
+void Fatfs::FileAllocationTable::Implementation::CreateFile(
+    std::string_view           path,
+    std::istream              &data,
+    std::optional<std::size_t> size)
+{
+    constexpr std::size_t kChunkSize   = 1024 * 1024;
+    constexpr std::size_t kMaxFileSize = 0xFFFFFFFF;
+
+    if (size > kMaxFileSize)
+        throw Errors::FileSystemError{"file would exceed the maximum size"};
+
+    const NewEntry newEntry = PrepareNewEntry(path, false);
+
+    // the entry is only inserted once the data is in place
+    EntryLocation location{};
+    location.Entry  = MakeDirectoryEntry(newEntry.Name,
+                                        Structures::RawAttributes::Archive,
+                                        0,
+                                        0);
+    location.Parent = newEntry.Parent;
+
+    Structures::DirectoryEntry &entry = location.Entry;
+
+    try
+    {
+        // a known size is reserved as one run up front; otherwise the chain
+        // grows a chunk at a time, still contiguously where there is room
+        if (size > 0)
+        {
+            static_cast<void>(ReserveClusters(
+                entry, RoundUp(*size, bytesPerCluster_) / bytesPerCluster_, true));
+        }
+
+        std::vector<std::byte> chunk(kChunkSize);
+
+        while (data)
+        {
+            data.read(reinterpret_cast<char *>(chunk.data()), chunk.size());
+
+            const std::size_t count = data.gcount();
+            if (count == 0)
+                break;
+
+            const std::size_t end = entry.FileSize + count;
+            if (end > kMaxFileSize)
+                throw Errors::FileSystemError{"file would exceed the maximum size"};
+
+            static_cast<void>(ReserveClusters(
+                entry, RoundUp(end, bytesPerCluster_) / bytesPerCluster_, true));
+            WriteAt(location, entry.FileSize, {chunk.data(), count});
+        }
+
+        if (data.bad())
+            throw std::runtime_error{"failed to read input"};
+
+        // the input may have been shorter than announced
+        ShrinkChain(entry, entry.FileSize);
+
+        location.Offset = InsertDirectoryEntry(newEntry.Parent, entry);
+    }
+    catch (...)
+    {
+        const std::size_t firstCluster =
+            entry.FirstClusterLow | entry.FirstClusterHigh << 16;
+        if (firstCluster != 0)
+            FreeClusterChain(firstCluster);
+
+        throw;
+    }
+
+    // write FAT
+    Flush();
+}
+
+void Fatfs::FileAllocationTable::Implementation::Copy(
+    std::string_view source,
+    std::string_view destination)
+{
+    constexpr std::size_t kBlockSize = 4 * 1024 * 1024;
+
+    const Structures::DirectoryEntry from = FindFile(source).Entry;
+    const std::size_t                fromCluster =
+        from.FirstClusterLow | from.FirstClusterHigh << 16;
+
+    const NewEntry newEntry = PrepareNewEntry(destination, false);
+
+    // the entry is only inserted once the data is in place
+    EntryLocation location{};
+    location.Entry  = MakeDirectoryEntry(newEntry.Name,
+                                        Structures::RawAttributes::Archive,
+                                        0,
+                                        0);
+    location.Parent = newEntry.Parent;
+
+    Structures::DirectoryEntry &entry = location.Entry;
+
+    try
+    {
+        if (fromCluster != 0 && from.FileSize > 0)
+        {
+            // a copy of the map, as the reads run beside changes to the cache
+            const std::vector<Extent> extents = GetExtentMap(fromCluster);
+            const std::size_t         size    = std::min(
+                std::size_t{from.FileSize},
+                (extents.back().Index + extents.back().Length) * bytesPerCluster_);
+
+            static_cast<void>(ReserveClusters(
+                entry, RoundUp(size, bytesPerCluster_) / bytesPerCluster_, true));
+
+            // the reads go around the stream, so it has to be flushed first;
+            // the descriptor is opened before a second thread uses it
+            fstream_.flush();
+            static_cast<void>(VolumeFd());
+
+            const auto read = [&](std::size_t offset, std::vector<std::byte> &block)
+            {
+                ForEachRun(extents,
+                           offset,
+                           std::min(kBlockSize, size - offset),
+                           [&](std::size_t position, std::size_t done, std::size_t count)
+                           { ReadVolume(position, block.data() + done, count); });
+            };
+
+            // two blocks: the next is read while the current one is written
+            std::array<std::vector<std::byte>, 2> blocks;
+            for (std::vector<std::byte> &block : blocks)
+                block.resize(std::min(kBlockSize, size));
+
+            read(0, blocks[0]);
+
+            for (std::size_t offset = 0, current = 0; offset < size;
+                 offset += kBlockSize, current ^= 1)
+            {
+                const std::size_t count = std::min(kBlockSize, size - offset);
+
+                // waits for the read on destruction, even if the write throws
+                std::future<void> next;
+                if (offset + count < size)
+                {
+                    next = std::async(std::launch::async,
+                                      read,
+                                      offset + count,
+                                      std::ref(blocks[current ^ 1]));
+                }
+
+                WriteAt(location, offset, {blocks[current].data(), count});
+
+                if (next.valid())
+                    next.get();
+            }
+        }
+
+        location.Offset = InsertDirectoryEntry(newEntry.Parent, entry);
+    }
+    catch (...)
+    {
+        const std::size_t firstCluster =
+            entry.FirstClusterLow | entry.FirstClusterHigh << 16;
+        if (firstCluster != 0)
+            FreeClusterChain(firstCluster);
+
+        throw;
+    }
+
+    // write FAT
+    Flush();
+}
+
+void Fatfs::FileAllocationTable::Implementation::CreateDirectory(
+    std::string_view path)
+{
+    const NewEntry newEntry = PrepareNewEntry(path, true);
+
+    const std::size_t cluster = AllocateClusterChain(1).front();
+
+    // create . and ..
+    const std::size_t entriesPerCluster =
+        bytesPerCluster_ / sizeof(Structures::DirectoryEntry);
+
+    std::vector<Structures::DirectoryEntry> entries(entriesPerCluster);
+
+    Helpers::Path::FatName dotName{};
+    dotName.fill(' ');
+    dotName[0] = '.';
+
+    entries[0] = MakeDirectoryEntry(dotName,
+                                    Structures::RawAttributes::Directory,
+                                    cluster,
+                                    0);
+
+    // no difference between . and .. except for name and first cluster; the
+    // root directory is always referred to as cluster 0
+    dotName[1] = '.';
+
+    entries[1] = MakeDirectoryEntry(dotName,
+                                    Structures::RawAttributes::Directory,
+                                    IsRootCluster(newEntry.Parent)
+                                        ? 0
+                                        : newEntry.Parent,
+                                    0);
+
+    // write directory
+    WriteMetadata(GetSlotOffset(cluster, 0), entries.data(), bytesPerCluster_);
+
+    try
+    {
+        InsertDirectoryEntry(
+            newEntry.Parent,
+            MakeDirectoryEntry(newEntry.Name,
+                               Structures::RawAttributes::Directory,
+                               cluster,
+                               0));
+    }
+    catch (...)
+    {
+        ReleaseClusters({&cluster, 1});
+        throw;
+    }
+
+    // write FAT
+    Flush();
+}
+
+void Fatfs::FileAllocationTable::Implementation::Append(
+    std::string_view           path,
+    std::span<const std::byte> data)
+{
+    EntryLocation     location = FindFile(path);
+    const std::size_t clusters = ChainLength(location.Entry);
+
+    try
+    {
+        WriteAt(location, location.Entry.FileSize, data);
+        UpdateFileEntry(location);
+    }
+    catch (...)
+    {
+        ShrinkChain(location.Entry, clusters * bytesPerCluster_);
+        throw;
+    }
+
+    Flush();
+}
+
+void Fatfs::FileAllocationTable::Implementation::Write(
+    std::string_view           path,
+    std::size_t                offset,
+    std::span<const std::byte> data)
+{
+    EntryLocation     location = FindFile(path);
+    const std::size_t clusters = ChainLength(location.Entry);
+
+    try
+    {
+        WriteAt(location, offset, data);
+        UpdateFileEntry(location);
+    }
+    catch (...)
+    {
+        ShrinkChain(location.Entry, clusters * bytesPerCluster_);
+        throw;
+    }
+
+    Flush();
+}
+
+void Fatfs::FileAllocationTable::Implementation::Truncate(std::string_view path,
+                                                          std::size_t      size)
+{
+    EntryLocation               location = FindFile(path);
+    Structures::DirectoryEntry &entry    = location.Entry;
+    const std::size_t           clusters = ChainLength(entry);
+
+    try
+    {
+        if (size > entry.FileSize)
+        {
+            // growing is writing nothing past the end; the gap is zeroed
+            WriteAt(location, size, {});
+        }
+        else
+        {
+            // also releases clusters reserved past the end by Preallocate
+            ShrinkChain(entry, size);
+
+            entry.FileSize = size;
+        }
+
+        UpdateFileEntry(location);
+    }
+    catch (...)
+    {
+        // a grown chain the entry never recorded would be lost
+        ShrinkChain(entry, clusters * bytesPerCluster_);
+        throw;
+    }
+
+    Flush();
+}
+
+void Fatfs::FileAllocationTable::Implementation::Preallocate(
+    std::string_view path,
+    std::size_t      size,
+    bool             keepSize)
+{
+    EntryLocation location{};
+    bool          created = false;
+
+    try
+    {
+        location = FindFile(path);
+    }
+    catch (const Errors::FileNotFoundError &)
+    {
+        // create it empty; the clusters are reserved below
+        const NewEntry newEntry = PrepareNewEntry(path, false);
+
+        location.Entry = MakeDirectoryEntry(newEntry.Name,
+                                            Structures::RawAttributes::Archive,
+                                            0,
+                                            0);
+        location.Parent = newEntry.Parent;
+        location.Offset = InsertDirectoryEntry(newEntry.Parent, location.Entry);
+
+        created = true;
+    }
+
+    const std::size_t neededClusters =
+        RoundUp(size, bytesPerCluster_) / bytesPerCluster_;
+    const std::size_t clusters = ChainLength(location.Entry);
+
+    try
+    {
+        if (neededClusters > 0)
+            static_cast<void>(ReserveClusters(location.Entry, neededClusters, true));
+
+        // the reserved space becomes part of the file; zero it rather than
+        // exposing whatever was there before
+        if (!keepSize && size > location.Entry.FileSize)
+            WriteAt(location, size, {});
+
+        UpdateFileEntry(location);
+    }
+    catch (...)
+    {
+        // a grown chain the entry never recorded would be lost, and a file
+        // created for the space is not wanted without it
+        ShrinkChain(location.Entry, clusters * bytesPerCluster_);
+        if (created)
+            MarkEntryDeleted(location);
+
+        throw;
+    }
+
+    Flush();
+}
+
+void Fatfs::FileAllocationTable::Implementation::CompactDirectory(
+    std::string_view path)
+{
+    DirectoryCursor   cursor    = OpenDirectory(path);
+    const std::size_t directory = cursor.FirstCluster;
+
+    // everything but deleted slots, in order, so that long name entries stay
+    // in front of the entry they belong to
+    std::vector<Structures::DirectoryEntry> entries{};
+    for (auto rawDir = ReadNextDirectoryCluster(cursor); !rawDir.empty();
+         rawDir      = ReadNextDirectoryCluster(cursor))
+    {
+        std::copy_if(rawDir.begin(),
+                     rawDir.end(),
+                     std::back_inserter(entries),
+                     [](const Structures::DirectoryEntry &x)
+                     {
+                         return x.Name[0] != 0xE5;
+                     });
+    }
+
+    if (directory == 0)
+    {
+        // the FAT12/FAT16 root directory has a fixed size
+        entries.resize(bpb_.RootDirEntries);
+
+        WriteMetadata(GetSlotOffset(0, 0),
+                      entries.data(),
+                      entries.size() * sizeof(Structures::DirectoryEntry));
+    }
+    else
+    {
+        const std::size_t entriesPerCluster =
+            bytesPerCluster_ / sizeof(Structures::DirectoryEntry);
+        const std::size_t neededClusters = std::max<std::size_t>(
+            RoundUp(entries.size(), entriesPerCluster) / entriesPerCluster,
+            1);
+
+        const std::vector<std::size_t> chain = ExtractClusterChain(directory);
+
+        // pad directory with 0s up until the next cluster boundary
+        entries.resize(neededClusters * entriesPerCluster);
+
+        for (std::size_t i = 0; i < neededClusters && i < chain.size(); i++)
+        {
+            WriteMetadata(GetSlotOffset(chain[i], 0),
+                          entries.data() + i * entriesPerCluster,
+                          bytesPerCluster_);
+        }
+
+        // trim the chain
+        if (neededClusters < chain.size())
+        {
+            SetCluster(chain[neededClusters - 1], endOfChainIndicator_);
+            FreeClusterChain(chain[neededClusters]);
+        }
+    }
+
+    // rebuilt on the next insertion
+    directorySlots_.erase(directory);
+
+    Flush();
+}
+
+void Fatfs::FileAllocationTable::Implementation::DeleteEntry(
+    std::string_view path,
+    bool             recursive)
+{
+    RemoveEntry(path, recursive, false);
+}
+
+void Fatfs::FileAllocationTable::Implementation::EraseEntry(
+    std::string_view path,
+    bool             recursive)
+{
+    RemoveEntry(path, recursive, true);
+}
+
+void Fatfs::FileAllocationTable::Implementation::RemoveEntry(
+    std::string_view path,
+    bool             recursive,
+    bool             erase)
+{
+    const Helpers::Path::FatComponents pathComponents{path};
+    if (pathComponents.empty())
+        throw Errors::InvalidPathError{"cannot remove the root directory"};
+
+    const Helpers::Path::FatName name = pathComponents.Back();
+    if (name[0] == '.')
+        throw Errors::InvalidPathError{"cannot remove '.' or '..' entries"};
+
+    const EntryLocation location = FindEntry(path, false);
+    const std::size_t   firstCluster =
+        location.Entry.FirstClusterLow | location.Entry.FirstClusterHigh << 16;
+
+    const bool isDirectory = IsBitSet(location.Entry.Attributes,
+                                      Structures::RawAttributes::Directory);
+
+    if (isDirectory && !recursive)
+    {
+        DirectoryCursor cursor = OpenDirectory(firstCluster);
+        while (const Structures::DirectoryEntry *entry =
+                   NextDirectoryEntry(cursor))
+        {
+            if (entry->Name[0] != '.')
+            {
+                throw Errors::InvalidFileOperationError{
+                    "directory " + std::string{path} + " is not empty"};
+            }
+        }
+    }
+
+    std::vector<Extent> erased{};
+
+    // mark the slot as deleted before freeing anything, so that a crash in
+    // between leaks clusters rather than leaving an entry pointing at free
+    // (and possibly reused) ones
+    MarkEntryDeleted(location);
+
+    if (isDirectory)
+        FreeDirectoryTree(firstCluster, erase ? &erased : nullptr);
+    else
+        FreeClusterChain(firstCluster, erase ? &erased : nullptr);
+
+    if (!erase)
+    {
+        // single metadata flush for the whole subtree
+        Flush();
+        return;
+    }
+
+    // the delete is committed before any data is zeroed, so that a crash in
+    // between leaves the old contents in free clusters, not a file of zeros
+    Commit();
+    ZeroRuns(erased);
+    fstream_.flush();
+}
+
+void Fatfs::FileAllocationTable::Implementation::Move(
+    std::string_view source,
+    std::string_view destination)
+{
+    const Helpers::Path::FatComponents sourceComponents{source};
+    if (sourceComponents.empty())
+        throw Errors::InvalidPathError{"cannot move the root directory"};
+
+    if (sourceComponents.Back()[0] == '.')
+        throw Errors::InvalidPathError{"cannot move '.' or '..' entries"};
+
+    const EntryLocation location = FindEntry(source, false);
+    const std::size_t   firstCluster =
+        location.Entry.FirstClusterLow | location.Entry.FirstClusterHigh << 16;
+
+    const bool isDirectory = IsBitSet(location.Entry.Attributes,
+                                      Structures::RawAttributes::Directory);
+
+    const NewEntry newEntry = PrepareNewEntry(destination, isDirectory);
+
+    // a directory cannot be moved into itself or one of its subdirectories;
+    // walk up from the new parent through the '..' entries
+    if (isDirectory)
+    {
+        for (std::size_t cluster = newEntry.Parent; !IsRootCluster(cluster);)
+        {
+            if (cluster == firstCluster)
+            {
+                throw Errors::InvalidFileOperationError{
+                    "cannot move directory " + std::string{source} +
+                    " into itself"};
+            }
+
+            Structures::DirectoryEntry dotDot{};
+            ReadMetadata(GetSlotOffset(cluster, 1), &dotDot, sizeof dotDot);
+
+            cluster = dotDot.FirstClusterLow | dotDot.FirstClusterHigh << 16;
+        }
+    }
+
+    // only the name changes; clusters, size and timestamps stay as they are
+    Structures::DirectoryEntry entry = location.Entry;
+    std::memcpy(entry.Name, newEntry.Name.data(), 8);
+    std::memcpy(entry.Extension, newEntry.Name.data() + 8, 3);
+
+    // insert the new entry before removing the old one, so that a crash in
+    // between leaves two entries rather than none
+    InsertDirectoryEntry(newEntry.Parent, entry);
+    MarkEntryDeleted(location);
+
+    if (isDirectory && newEntry.Parent != location.Parent)
+    {
+        const std::size_t parent =
+            IsRootCluster(newEntry.Parent) ? 0 : newEntry.Parent;
+
+        Structures::DirectoryEntry dotDot{};
+        ReadMetadata(GetSlotOffset(firstCluster, 1), &dotDot, sizeof dotDot);
+
+        dotDot.FirstClusterHigh = (parent & 0xFFFF0000) >> 16;
+        dotDot.FirstClusterLow  = parent & 0xFFFF;
+
+        WriteMetadata(GetSlotOffset(firstCluster, 1), &dotDot, sizeof dotDot);
+    }
+
+    Flush();
+}
+
+void Fatfs::FileAllocationTable::Implementation::MarkEntryDeleted(
+    const EntryLocation &location)
+{
+    constexpr auto kDeleted = static_cast<char>(0xE5);
+    WriteMetadata(location.Offset, &kDeleted, 1);
+
+    if (auto it = directorySlots_.find(location.Parent);
+        it != directorySlots_.end())
+    {
+        it->second.Deleted.emplace_back(location.Offset);
+    }
+}
+
+void Fatfs::FileAllocationTable::Implementation::FreeDirectoryTree(
+    std::size_t          firstCluster,
+    std::vector<Extent> *erased)
+{
+    DirectoryCursor cursor = OpenDirectory(firstCluster);
+
+    // children first; the directory's own chain is still needed to iterate it
+    while (const Structures::DirectoryEntry *entry = NextDirectoryEntry(cursor))
+    {
+        if (entry->Name[0] == '.') // "." and ".."
+            continue;
+
+        const std::size_t cluster =
+            entry->FirstClusterLow | entry->FirstClusterHigh << 16;
+
+        if (IsBitSet(entry->Attributes, Structures::RawAttributes::Directory))
+            FreeDirectoryTree(cluster, erased);
+        else
+            FreeClusterChain(cluster, erased);
+    }
+
+    FreeClusterChain(firstCluster, erased);
+    directorySlots_.erase(firstCluster);
+}
+
+void Fatfs::FileAllocationTable::Implementation::FreeClusterChain(
+    std::size_t          firstCluster,
+    std::vector<Extent> *erased)
+{
+    std::size_t cluster  = firstCluster;
+    std::size_t runStart = 0; // first cluster of the current contiguous run
+    std::size_t runSize  = 0;
+
+    extentMaps_.erase(firstCluster);
+
+    const auto recordRun = [&]
+    {
+        if (erased != nullptr && runSize != 0)
+            erased->push_back({0, runStart, runSize});
+    };
+
+    while (cluster >= 2 && cluster < fatEntryCount_ &&
+           !IsEndOfClusterChain(cluster))
+    {
+        const std::size_t next = ExtractCluster(cluster);
+        if (next == 0)
+            break; // already free; don't touch clusters we don't own
+
+        if (runSize != 0 && cluster == runStart + runSize)
+        {
+            runSize++;
+        }
+        else
+        {
+            recordRun();
+            runStart = cluster;
+            runSize  = 1;
+        }
+
+        SetCluster(cluster, 0);
+        cluster = next;
+    }
+
+    recordRun();
+}
+
+void Fatfs::FileAllocationTable::Implementation::ZeroRuns(
+    std::span<const Extent> runs)
+{
+    constexpr std::size_t kMaxZeroWrite = 1024 * 1024;
+
+    std::vector<std::byte> zeros{};
+
+    for (const Extent &run : runs)
+    {
+        std::size_t remaining = run.Length * bytesPerCluster_;
+        if (zeros.size() < std::min(remaining, kMaxZeroWrite))
+            zeros.resize(std::min(remaining, kMaxZeroWrite));
+
+        // one sequential stream of large writes per run
+        fstream_.seekp(ConvertClusterToSector(run.Cluster) * bpb_.BytesPerSector);
+        while (remaining > 0)
+        {
+            const std::size_t length = std::min(remaining, zeros.size());
+            fstream_.write(reinterpret_cast<const char *>(zeros.data()),
+                           length);
+            remaining -= length;
+        }
+    }
+}
+
+Fatfs::FileSystemVersion
+Fatfs::FileAllocationTable::Implementation::Version() const
+{
+    return version_;
+}
+
+std::size_t Fatfs::FileAllocationTable::Implementation::FreeSpace()
+{
+    if (!freeClusterCount_)
+    {
+        freeClusterCount_ = CountFreeClusters();
+        fsInfoDirty_      = true; // repair a missing or stale FSInfo count
+    }
+
+    return *freeClusterCount_ * bytesPerCluster_;
+}
+
+Fatfs::FileAllocationTable::Implementation::NewEntry
+Fatfs::FileAllocationTable::Implementation::PrepareNewEntry(
+    std::string_view path,
+    bool             isDirectory)
+{
+    const std::string_view newPath = Utilities::String::TrimStringView(path);
+    if (newPath.empty())
+        throw Errors::InvalidPathError{"path is empty"};
+
+    // get parent directory
+    const Helpers::Path::FatComponents pathComponents{newPath};
+
+    NewEntry newEntry{};
+    newEntry.Name = pathComponents.Back();
+
+    // DirectoryEntry::name[0] == 0x20 is illegal
+    if (newEntry.Name[0] == ' ' || newEntry.Name[0] == '.')
+    {
+        throw Errors::InvalidPathError{
+            "first character of name shall not be 0x20 (or shall not start "
+            "with a period)"};
+    }
+
+    newEntry.Parent = OpenDirectory(pathComponents.Parent()).FirstCluster;
+
+    // a file and a directory cannot share a name either
+    bool exists = true;
+    try
+    {
+        static_cast<void>(FindEntry(newPath, false));
+    }
+    catch (const Errors::FileNotFoundError &)
+    {
+        exists = false;
+    }
+
+    if (exists)
+    {
+        if (isDirectory)
+            throw Errors::FileAlreadyExistsError{
+                "directory " + std::string{newPath} + " already exists"};
+
+        throw Errors::FileAlreadyExistsError{"file " + std::string{newPath} +
+                                             " already exists"};
+    }
+
+    return newEntry;
+}
+
+Fatfs::Structures::DirectoryEntry
+Fatfs::FileAllocationTable::Implementation::MakeDirectoryEntry(
+    const Helpers::Path::FatName &name,
+    std::uint8_t                  attributes,
+    std::size_t                   firstCluster,
+    std::size_t                   fileSize) const
+{
+    auto [time, date] = Helpers::Time::ConvertUnixTimeToFatTime(
+        std::chrono::system_clock::now(),
+        utcOffset_);
+
+    Structures::DirectoryEntry entry{};
+
+    // copy filename and extension
+    std::memcpy(entry.Name, name.data(), 8);
+    std::memcpy(entry.Extension, name.data() + 8, 3);
+
+    entry.Attributes = attributes;
+
+    // set fields
+    entry.CreationDate         = date;
+    entry.CreationTime         = time;
+    entry.CreationTimeTenths   = 0;
+    entry.LastAccessDate       = date;
+    entry.FirstClusterHigh     = (firstCluster & 0xFFFF0000) >> 16; // high 16 bits
+    entry.LastModificationTime = time;
+    entry.LastModificationDate = date;
+    entry.FirstClusterLow      = firstCluster & 0xFFFF; // low 16 bits
+    entry.FileSize             = fileSize;
+
+    return entry;
+}
+
+Fatfs::FileAllocationTable::Implementation::DirectorySlots &
+Fatfs::FileAllocationTable::Implementation::GetDirectorySlots(
+    std::size_t directory)
+{
+    if (auto it = directorySlots_.find(directory); it != directorySlots_.end())
+        return it->second;
+
+    // scan the directory once; afterwards the index is kept up to date by
+    // insertions and deletions
+    DirectorySlots  slots{};
+    DirectoryCursor cursor = OpenDirectory(directory);
+
+    for (auto rawDir = ReadNextDirectoryCluster(cursor); !rawDir.empty();
+         rawDir      = ReadNextDirectoryCluster(cursor))
+    {
+        for (const auto &entry : rawDir)
+        {
+            if (entry.Name[0] == 0xE5)
+                slots.Deleted.emplace_back(GetEntryOffset(cursor, &entry));
+        }
+    }
+
+    if (cursor.HitEndMarker)
+    {
+        slots.TailCluster = cursor.Cluster;
+        slots.TailIndex   = cursor.Entries;
+    }
+    else
+    {
+        slots.Full = true;
+    }
+
+    // find the last cluster of the chain, in case it has to grow
+    if (directory != 0)
+    {
+        slots.LastCluster = slots.Full ? directory : slots.TailCluster;
+        for (std::size_t next = ExtractCluster(slots.LastCluster);
+             next >= 2 && !IsEndOfClusterChain(next);
+             next = ExtractCluster(next))
+        {
+            slots.LastCluster = next;
+        }
+    }
+
+    return directorySlots_.emplace(directory, std::move(slots)).first->second;
+}
+
+std::size_t Fatfs::FileAllocationTable::Implementation::InsertDirectoryEntry(
+    std::size_t                       directory,
+    const Structures::DirectoryEntry &entry)
+{
+    DirectorySlots &slots = GetDirectorySlots(directory);
+
+    std::size_t offset = 0;
+
+    if (!slots.Deleted.empty())
+    {
+        // reuse a deleted slot
+        offset = slots.Deleted.back();
+        slots.Deleted.pop_back();
+    }
+    else
+    {
+        if (slots.Full)
+            ExtendDirectory(directory, slots);
+
+        const std::size_t capacity =
+            slots.TailCluster == 0
+                ? bpb_.RootDirEntries
+                : bytesPerCluster_ / sizeof(Structures::DirectoryEntry);
+
+        offset = GetSlotOffset(slots.TailCluster, slots.TailIndex);
+
+        // move the end marker one slot further; slots after the marker may
+        // hold stale data, so the next one is cleared explicitly
+        std::size_t marker = 0;
+        if (++slots.TailIndex < capacity)
+        {
+            marker = GetSlotOffset(slots.TailCluster, slots.TailIndex);
+        }
+        else if (const std::size_t next = slots.TailCluster == 0
+                                             ? 0
+                                             : ExtractCluster(slots.TailCluster);
+                 next >= 2 && !IsEndOfClusterChain(next))
+        {
+            slots.TailCluster = next;
+            slots.TailIndex   = 0;
+
+            marker = GetSlotOffset(next, 0);
+        }
+        else
+        {
+            slots.Full = true;
+        }
+
+        if (marker != 0)
+        {
+            constexpr char kEndOfDirectory = '\0';
+            WriteMetadata(marker, &kEndOfDirectory, 1);
+        }
+    }
+
+    WriteMetadata(offset, &entry, sizeof entry);
+
+    return offset;
+}
+
+void Fatfs::FileAllocationTable::Implementation::ExtendDirectory(
+    std::size_t     directory,
+    DirectorySlots &slots)
+{
+    // check if exceeding the maximum number of entries in a directory IF
+    // we're in the root directory and IF we're in a non-FAT32 volume
+    if (directory == 0)
+    {
+        throw Errors::FileSystemError{"maximum number of entries in root "
+                                      "directory exceeded"};
+    }
+
+    const std::size_t newCluster = AllocateClusterChain(1).front();
+    SetCluster(slots.LastCluster, newCluster);
+
+    // a new directory cluster must not contain anything that looks like an
+    // entry
+    const std::vector<std::byte> zeros(bytesPerCluster_);
+    WriteMetadata(GetSlotOffset(newCluster, 0), zeros.data(), zeros.size());
+
+    slots.LastCluster = newCluster;
+    slots.TailCluster = newCluster;
+    slots.TailIndex   = 0;
+    slots.Full        = false;
+}
+
+std::size_t Fatfs::FileAllocationTable::Implementation::GetSlotOffset(
+    std::size_t cluster,
+    std::size_t index) const
+{
+    const std::size_t sector =
+        cluster == 0 ? firstRootDirSector_ : ConvertClusterToSector(cluster);
+
+    return sector * bpb_.BytesPerSector +
+           index * sizeof(Structures::DirectoryEntry);
+}
+
+std::vector<std::size_t>
+Fatfs::FileAllocationTable::Implementation::AllocateClusterChain(
+    std::size_t count)
+{
+    std::vector<std::size_t> clusters{};
+    clusters.reserve(count);
+
+    for (std::size_t i = 0; i < count; i++)
+    {
+        const std::size_t cluster = clusters.empty()
+                                      ? GetNextFreeCluster()
+                                      : GetNextFreeCluster(clusters.back());
+        if (cluster == 0)
+        {
+            // give back what was taken so far
+            ReleaseClusters(clusters);
+            throw Errors::FileSystemError{"no free clusters left on volume"};
+        }
+
+        SetCluster(cluster, endOfChainIndicator_);
+        if (!clusters.empty())
+            SetCluster(clusters.back(), cluster);
+
+        clusters.emplace_back(cluster);
+    }
+
+    return clusters;
+}
+
+std::vector<std::size_t>
+Fatfs::FileAllocationTable::Implementation::AllocateContiguousClusters(
+    std::size_t count,
+    std::size_t preferred)
+{
+    // right after the end of the chain if possible, so that it stays in one
+    // run; otherwise the first free run that is large enough
+    bool followsChain = preferred >= 2 && preferred + count <= fatEntryCount_;
+    for (std::size_t i = 0; followsChain && i < count; i++)
+        followsChain = IsClusterFree(preferred + i);
+
+    const std::size_t first =
+        followsChain ? preferred : FindFreeRun(count, nextFreeHint_);
+
+    // no run is large enough; take whatever is free
+    if (first == 0)
+        return AllocateClusterChain(count);
+
+    std::vector<std::size_t> clusters(count);
+    for (std::size_t i = 0; i < count; i++)
+    {
+        clusters[i] = first + i;
+        SetCluster(first + i, i + 1 < count ? first + i + 1 : endOfChainIndicator_);
+    }
+
+    return clusters;
+}
+
+std::size_t Fatfs::FileAllocationTable::Implementation::FindFreeRun(
+    std::size_t count,
+    std::size_t startCluster)
+{
+    if (count == 0 || (freeClusterCount_ && *freeClusterCount_ < count))
+        return 0;
+
+    if (startCluster < 2 || startCluster >= fatEntryCount_)
+        startCluster = 2;
+
+    // search forward from the start cluster, then wrap around; a run cannot
+    // wrap
+    std::size_t runStart  = 0;
+    std::size_t runLength = 0;
+
+    for (std::size_t i = 0; i < fatEntryCount_ - 2; i++)
+    {
+        const std::size_t cluster = 2 + (startCluster - 2 + i) % (fatEntryCount_ - 2);
+        if (cluster == 2)
+            runLength = 0;
+
+        if (!IsClusterFree(cluster))
+        {
+            runLength = 0;
+            continue;
+        }
+
+        if (runLength++ == 0)
+            runStart = cluster;
+
+        if (runLength == count)
+            return runStart;
+    }
+
+    return 0;
+}
+
+void Fatfs::FileAllocationTable::Implementation::ReleaseClusters(
+    std::span<const std::size_t> clusters)
+{
+    for (const std::size_t cluster : clusters)
+        SetCluster(cluster, 0);
+}
+
+Fatfs::EntryLocation
+Fatfs::FileAllocationTable::Implementation::FindFile(std::string_view path)
+{
+    DirectoryCursor cursor{};
+    return FindFile(path, cursor);
+}
+
+Fatfs::EntryLocation
+Fatfs::FileAllocationTable::Implementation::FindFile(std::string_view path,
+                                                     DirectoryCursor &cursor)
+{
+    EntryLocation location = FindEntry(path, false, cursor);
+
+    if (IsBitSet(location.Entry.Attributes,
+                 Structures::RawAttributes::Directory))
+    {
+        throw Errors::InvalidFileOperationError{
+            std::string{path} + " is a directory, not a file"};
+    }
+
+    return location;
+}
+
+void Fatfs::FileAllocationTable::Implementation::WriteAt(
+    EntryLocation             &location,
+    std::size_t                offset,
+    std::span<const std::byte> data)
+{
+    constexpr std::size_t kMaxZeroWrite = 1024 * 1024;
+    constexpr std::size_t kMaxFileSize  = 0xFFFFFFFF;
+
+    Structures::DirectoryEntry &entry = location.Entry;
+
+    const std::size_t end = offset + data.size();
+    if (end > kMaxFileSize)
+        throw Errors::FileSystemError{"file would exceed the maximum size"};
+
+    if (end == 0)
+        return;
+
+    // the whole chain in one go, so that a full volume is found out before
+    // anything is written
+    const std::vector<Extent> &extents = ReserveClusters(
+        entry, RoundUp(end, bytesPerCluster_) / bytesPerCluster_, false);
+
+    // write the affected clusters only
+    const auto write = [&](std::size_t at, const std::byte *bytes, std::size_t length)
+    {
+        ForEachRun(extents,
+                   at,
+                   length,
+                   [&](std::size_t position, std::size_t done, std::size_t count)
+                   {
+                       fstream_.seekp(position);
+                       fstream_.write(reinterpret_cast<const char *>(bytes + done),
+                                      count);
+                   });
+    };
+
+    if (offset > entry.FileSize)
+    {
+        // fill the gap between the current end and offset with zeros
+        const std::vector<std::byte> zeros(
+            std::min(offset - entry.FileSize, kMaxZeroWrite));
+
+        for (std::size_t at = entry.FileSize; at < offset; at += zeros.size())
+            write(at, zeros.data(), std::min(zeros.size(), offset - at));
+    }
+
+    write(offset, data.data(), data.size());
+
+    entry.FileSize = std::max<std::size_t>(entry.FileSize, end);
+}
+
+std::vector<Fatfs::FileAllocationTable::Implementation::Extent> &
+Fatfs::FileAllocationTable::Implementation::ReserveClusters(
+    Structures::DirectoryEntry &entry,
+    std::size_t                 clusterCount,
+    bool                        contiguous)
+{
+    // an entry without a chain would have no map to return
+    if (clusterCount == 0)
+        throw Errors::InvalidFileOperationError{"no clusters to reserve"};
+
+    std::size_t firstCluster =
+        entry.FirstClusterLow | entry.FirstClusterHigh << 16;
+
+    std::vector<Extent> *extents =
+        firstCluster == 0 ? nullptr : &GetExtentMap(firstCluster);
+    const std::size_t chainLength = ChainLength(entry);
+
+    if (clusterCount <= chainLength)
+        return *extents;
+
+    // grow from the cached tail
+    const std::size_t tailCluster =
+        extents == nullptr ? 0
+                           : extents->back().Cluster + extents->back().Length - 1;
+
+    const std::vector<std::size_t> added =
+        contiguous ? AllocateContiguousClusters(clusterCount - chainLength,
+                                                tailCluster + 1)
+                   : AllocateClusterChain(clusterCount - chainLength);
+
+    if (firstCluster == 0)
+    {
+        firstCluster           = added.front();
+        entry.FirstClusterHigh = (firstCluster & 0xFFFF0000) >> 16;
+        entry.FirstClusterLow  = firstCluster & 0xFFFF;
+
+        extents = &extentMaps_[firstCluster];
+    }
+    else
+    {
+        SetCluster(tailCluster, added.front());
+    }
+
+    AppendExtents(*extents, added);
+
+    return *extents;
+}
+
+std::size_t Fatfs::FileAllocationTable::Implementation::ChainLength(
+    const Structures::DirectoryEntry &entry)
+{
+    const std::size_t firstCluster =
+        entry.FirstClusterLow | entry.FirstClusterHigh << 16;
+    if (firstCluster == 0)
+        return 0;
+
+    const std::vector<Extent> &extents = GetExtentMap(firstCluster);
+    return extents.back().Index + extents.back().Length;
+}
+
+void Fatfs::FileAllocationTable::Implementation::ShrinkChain(
+    Structures::DirectoryEntry &entry,
+    std::size_t                 size)
+{
+    const std::size_t firstCluster =
+        entry.FirstClusterLow | entry.FirstClusterHigh << 16;
+    const std::size_t keep = RoundUp(size, bytesPerCluster_) / bytesPerCluster_;
+
+    if (firstCluster != 0 && keep == 0)
     {
-    case FileSystemVersion::Fat12:
+        FreeClusterChain(firstCluster);
+
+        entry.FirstClusterHigh = 0;
+        entry.FirstClusterLow  = 0;
+    }
+    else if (firstCluster != 0)
     {
-        const auto orig = cluster;
+        std::vector<Extent> &extents = GetExtentMap(firstCluster);
 
-        cluster = cluster * 3 / 2;
-        cluster = *reinterpret_cast<const std::uint16_t *>(
-            saFat + cluster); // basically, get 2 bytes from location of FAT +
-        // cluster (no pointer arithmetic)
+        const std::size_t last = LocateCluster(extents, keep - 1);
+        const std::size_t next = ExtractCluster(last);
+        if (next >= 2 && !IsEndOfClusterChain(next))
+        {
+            SetCluster(last, endOfChainIndicator_);
+            FreeClusterChain(next);
+        }
+
+        // cut the map at the new end
+        while (extents.back().Index >= keep)
+            extents.pop_back();
+        extents.back().Length = keep - extents.back().Index;
+    }
+}
+
+void Fatfs::FileAllocationTable::Implementation::UpdateFileEntry(
+    EntryLocation &location)
+{
+    auto [time, date] = Helpers::Time::ConvertUnixTimeToFatTime(
+        std::chrono::system_clock::now(),
+        utcOffset_);
 
-        if (orig % 2 == 0)
-            cluster &= 0xFFF;
+    Structures::DirectoryEntry &entry = location.Entry;
+
+    entry.Attributes |= Structures::RawAttributes::Archive;
+    entry.LastModificationTime = time;
+    entry.LastModificationDate = date;
+    entry.LastAccessDate       = date;
+
+    WriteMetadata(location.Offset, &entry, sizeof entry);
+}
+
+std::vector<Fatfs::FileAllocationTable::Implementation::Extent> &
+Fatfs::FileAllocationTable::Implementation::GetExtentMap(
+    std::size_t firstCluster)
+{
+    if (auto it = extentMaps_.find(firstCluster); it != extentMaps_.end())
+        return it->second;
+
+    const auto broken = [firstCluster]
+    {
+        return Errors::FileSystemError{"broken cluster chain starting at " +
+                                       std::to_string(firstCluster)};
+    };
+
+    if (firstCluster < 2 || firstCluster >= fatEntryCount_)
+        throw broken();
+
+    // one walk of the chain, stored as runs of contiguous clusters. a corrupt
+    // FAT may point outside itself or loop; no valid chain is longer than
+    // the FAT has clusters
+    std::vector<Extent> extents{{0, firstCluster, 1}};
+    for (std::size_t next = ExtractCluster(firstCluster);
+         next >= 2 && !IsEndOfClusterChain(next);
+         next = ExtractCluster(next))
+    {
+        Extent &last = extents.back();
+
+        if (next >= fatEntryCount_ || last.Index + last.Length >= fatEntryCount_ - 2)
+            throw broken();
+
+        if (next == last.Cluster + last.Length)
+            last.Length++;
         else
-            cluster >>= 4;
+            extents.push_back({last.Index + last.Length, next, 1});
     }
-    break;
+
+    return extentMaps_.emplace(firstCluster, std::move(extents)).first->second;
+}
+
+void Fatfs::FileAllocationTable::Implementation::AppendExtents(
+    std::vector<Extent>         &extents,
+    std::span<const std::size_t> clusters)
+{
+    for (const std::size_t cluster : clusters)
+    {
+        if (extents.empty())
+        {
+            extents.push_back({0, cluster, 1});
+            continue;
+        }
+
+        Extent &last = extents.back();
+
+        if (cluster == last.Cluster + last.Length)
+            last.Length++;
+        else
+            extents.push_back({last.Index + last.Length, cluster, 1});
+    }
+}
+
+std::size_t Fatfs::FileAllocationTable::Implementation::LocateCluster(
+    const std::vector<Extent> &extents,
+    std::size_t                index)
+{
+    // last extent starting at or before index
+    const auto it = std::prev(std::upper_bound(
+        extents.begin(),
+        extents.end(),
+        index,
+        [](std::size_t value, const Extent &extent)
+        {
+            return value < extent.Index;
+        }));
+
+    return it->Cluster + (index - it->Index);
+}
+
+template<typename F>
+void Fatfs::FileAllocationTable::Implementation::ForEachRun(
+    const std::vector<Extent> &extents,
+    std::size_t                offset,
+    std::size_t                length,
+    F                        &&function) const
+{
+    if (length == 0)
+        return;
+
+    auto it = std::prev(std::upper_bound(
+        extents.begin(),
+        extents.end(),
+        offset / bytesPerCluster_,
+        [](std::size_t value, const Extent &extent)
+        {
+            return value < extent.Index;
+        }));
+
+    for (std::size_t done = 0; done < length && it != extents.end(); ++it)
+    {
+        const std::size_t runOffset = offset + done - it->Index * bytesPerCluster_;
+        const std::size_t count =
+            std::min(it->Length * bytesPerCluster_ - runOffset, length - done);
+
+        function(ConvertClusterToSector(it->Cluster) * bpb_.BytesPerSector +
+                     runOffset,
+                 done,
+                 count);
+
+        done += count;
+    }
+}
+
+std::size_t Fatfs::FileAllocationTable::Implementation::ExtractCluster(
+    size_t clusterNumber)
+{
+    std::size_t cluster = clusterNumber;
+
+    switch (version_)
+    {
+    case FileSystemVersion::Fat12:
+        cluster = fat12_[cluster];
+        break;
     case FileSystemVersion::Fat16:
-        cluster = reinterpret_cast<const std::uint16_t *>(saFat)[cluster];
+        cluster = *reinterpret_cast<const std::uint16_t *>(
+            FatBytes(cluster * sizeof(std::uint16_t)));
         break;
     case FileSystemVersion::Fat32:
-        cluster = reinterpret_cast<const std::uint32_t *>(saFat)[cluster];
+        // some weird software fills the upper 4 bits, so we need to mask them
+        // out
+        cluster = *reinterpret_cast<const std::uint32_t *>(
+                      FatBytes(cluster * sizeof(std::uint32_t))) &
+                  0x0FFFFFFF;
         break;
     }
 
@@ -655,184 +2364,471 @@ void Fatfs::FileAllocationTable::Implementation::SetCluster(
     size_t next)
 {
     std::size_t cluster = clusterNumber;
-    auto        saFat   = reinterpret_cast<std::uintptr_t>(fat_.data());
 
-    switch (version_)
+    // keep the free count and allocation hint in step with the FAT
+    if (const std::size_t old = ExtractCluster(cluster); old == 0 && next != 0)
     {
-    case FileSystemVersion::Fat12:
+        if (freeClusterCount_)
+            --*freeClusterCount_;
+
+        nextFreeHint_ = cluster + 1;
+        fsInfoDirty_  = true;
+    }
+    else if (old != 0 && next == 0)
     {
-        cluster               = cluster * 3 / 2;
-        const auto clusterPtr = reinterpret_cast<uint16_t *>(saFat + cluster);
+        if (freeClusterCount_)
+            ++*freeClusterCount_;
 
-        *clusterPtr |= cluster % 2 == 0
-                           ? next << 4      // if even, store in upper 12 bits
-                           : next & 0x0FFF; // else, store in low 12 bits
+        fsInfoDirty_ = true;
+
+        // the committed FAT, or the one on disk while updates to it are
+        // deferred, may still point here; don't hand it out again before the
+        // group is written
+        if (journal_ || operationsPerFlush_ > 1)
+            pendingFreeClusters_.insert(cluster);
     }
-    break;
+
+    switch (version_)
+    {
+    case FileSystemVersion::Fat12:
+        fat12_[cluster] = next & 0x0FFF;
+        break;
     case FileSystemVersion::Fat16:
-        reinterpret_cast<uint16_t *>(saFat)[cluster] = next;
+        *reinterpret_cast<std::uint16_t *>(
+            FatBytes(cluster * sizeof(std::uint16_t))) = next;
         break;
     case FileSystemVersion::Fat32:
-        reinterpret_cast<uint32_t *>(saFat)[cluster] = next;
-        break;
+    {
+        // the upper 4 bits are reserved and must be preserved
+        auto *entry = reinterpret_cast<std::uint32_t *>(
+            FatBytes(cluster * sizeof(std::uint32_t)));
+        *entry = (*entry & 0xF0000000) | (next & 0x0FFFFFFF);
+    }
+    break;
     }
+
+    MarkFatEntryDirty(clusterNumber);
 }
 
-std::vector<std::size_t>
-Fatfs::FileAllocationTable::Implementation::ExtractClusterChain(
-    size_t startCluster) const
+std::byte *
+Fatfs::FileAllocationTable::Implementation::FatBytes(std::size_t offset)
 {
-    std::vector<std::size_t> chain;
-    std::size_t              cluster = startCluster;
+    if (!fatPaged_)
+        return fat_.data() + offset;
 
-    // pretty self-explanatory
-    do
+    const std::size_t pageBytes = kFatPageSectors * bpb_.BytesPerSector;
+
+    return LoadFatPage(offset / pageBytes).Data.data() + offset % pageBytes;
+}
+
+Fatfs::FileAllocationTable::Implementation::FatPage &
+Fatfs::FileAllocationTable::Implementation::LoadFatPage(std::size_t page)
+{
+    if (auto it = fatPages_.find(page); it != fatPages_.end())
     {
-        chain.emplace_back(cluster);
-        cluster = ExtractCluster(cluster);
-    } while (!IsEndOfClusterChain(cluster));
+        // mark as most recently used
+        fatPageLru_.splice(fatPageLru_.begin(),
+                           fatPageLru_,
+                           it->second.Position);
+        return it->second;
+    }
 
-    return chain;
+    if (fatPages_.size() >= maxFatPages_)
+        EvictFatPage();
+
+    const std::size_t firstSector = page * kFatPageSectors;
+    const std::size_t sectors =
+        std::min(kFatPageSectors, sectorsPerFat_ - firstSector);
+
+    FatPage fatPage{};
+    fatPage.Data.resize(sectors * bpb_.BytesPerSector);
+
+    ReadMetadata((firstFatSector_ + activeFat_ * sectorsPerFat_ + firstSector) *
+                     bpb_.BytesPerSector,
+                 fatPage.Data.data(),
+                 fatPage.Data.size());
+
+    fatPageLru_.push_front(page);
+    fatPage.Position = fatPageLru_.begin();
+
+    return fatPages_.emplace(page, std::move(fatPage)).first->second;
 }
 
-std::size_t Fatfs::FileAllocationTable::Implementation::GetNextFreeCluster(
-    size_t startCluster) const
+void Fatfs::FileAllocationTable::Implementation::EvictFatPage()
+{
+    const std::size_t page        = fatPageLru_.back();
+    const std::size_t firstSector = page * kFatPageSectors;
+
+    // write back before dropping the page
+    FlushFatSectors(firstSector,
+                    std::min(firstSector + kFatPageSectors, sectorsPerFat_));
+
+    fatPageLru_.erase(fatPages_.at(page).Position);
+    fatPages_.erase(page);
+}
+
+void Fatfs::FileAllocationTable::Implementation::WriteFatSectors(
+    std::size_t      sector,
+    std::size_t      count,
+    const std::byte *data)
+{
+    for (std::size_t i = 0; i < bpb_.NumberOfFats; i++)
+    {
+        if (!fatMirroring_ && i != activeFat_)
+            continue;
+
+        WriteMetadata((firstFatSector_ + i * sectorsPerFat_ + sector) *
+                          bpb_.BytesPerSector,
+                      data,
+                      count * bpb_.BytesPerSector);
+    }
+}
+
+void Fatfs::FileAllocationTable::Implementation::MarkFatEntryDirty(
+    std::size_t clusterNumber)
 {
-    auto saFat = reinterpret_cast<std::uintptr_t>(fat_.data());
+    std::size_t first = 0;
+    std::size_t last  = 0; // byte offsets of the entry in the FAT
 
     switch (version_)
     {
     case FileSystemVersion::Fat12:
-    {
-        for (std::size_t i = startCluster + 1; i < fat_.size() * 2 / 3; i++)
-        {
-            const auto  orig    = i;
-            std::size_t cluster = i * 3 / 2;
-            cluster = *reinterpret_cast<const uint16_t *>(saFat + cluster);
+        first = clusterNumber * 3 / 2;
+        last  = first + 1; // a FAT12 entry may straddle two sectors
+        break;
+    case FileSystemVersion::Fat16:
+        first = last = clusterNumber * 2;
+        break;
+    case FileSystemVersion::Fat32:
+        first = last = clusterNumber * 4;
+        break;
+    }
 
-            if (orig % 2 == 0)
-                cluster &= 0xFFF;
-            else
-                cluster >>= 4;
+    dirtyFatSectors_[first / bpb_.BytesPerSector] = true;
+    dirtyFatSectors_[last / bpb_.BytesPerSector]  = true;
+}
 
-            if (cluster == 0)
-                return i;
-        }
-    }
-    break;
-    case FileSystemVersion::Fat16:
+void Fatfs::FileAllocationTable::Implementation::RepackFat12Sector(
+    std::size_t sector)
+{
+    const std::size_t firstByte = sector * bpb_.BytesPerSector;
+    const std::size_t lastByte  = firstByte + bpb_.BytesPerSector;
+
+    // every entry that has at least one nibble inside the sector
+    const std::size_t first = firstByte == 0 ? 0 : (firstByte - 1) * 2 / 3;
+    const std::size_t last  = std::min(lastByte * 2 / 3 + 1, fat12_.size());
+
+    for (std::size_t i = first; i < last; i++)
     {
-        for (std::size_t i = startCluster + 1;
-             i < fat_.size() / 2 /* sizeof(uint16_t) */;
-             i++)
+        const std::size_t   offset = i * 3 / 2;
+        const std::uint16_t value  = fat12_[i];
+
+        if (i % 2 == 0) // low 12 bits of the 16-bit word
         {
-            if (const std::uint16_t cluster =
-                    reinterpret_cast<const uint16_t *>(saFat)[i];
-                cluster == 0)
-            {
-                return i;
-            }
+            fat_[offset]     = std::byte(value & 0xFF);
+            fat_[offset + 1] = (fat_[offset + 1] & std::byte{0xF0}) |
+                               std::byte(value >> 8 & 0x0F);
+        }
+        else // high 12 bits of the 16-bit word
+        {
+            fat_[offset]     = (fat_[offset] & std::byte{0x0F}) |
+                           std::byte((value & 0x0F) << 4);
+            fat_[offset + 1] = std::byte(value >> 4 & 0xFF);
         }
     }
-    break;
-    default /* FAT32 */:
+}
+
+void Fatfs::FileAllocationTable::Implementation::FlushFatSectors(
+    std::size_t first,
+    std::size_t last)
+{
+    // a run of dirty sectors must not cross a page boundary when paged
+    const std::size_t runLimit =
+        fatPaged_ ? kFatPageSectors : dirtyFatSectors_.size();
+
+    std::size_t sector = first;
+
+    while (sector < last)
     {
-        for (std::size_t i = startCluster + 1;
-             i < fat_.size() / 4 /* sizeof(uint32_t) */;
-             i++)
+        if (!dirtyFatSectors_[sector])
         {
-            if (const std::uint32_t cluster =
-                    reinterpret_cast<const uint32_t *>(saFat)[i];
-                cluster == 0)
-            {
-                return i;
-            }
+            sector++;
+            continue;
+        }
+
+        // coalesce a run of dirty sectors into a single write per FAT copy
+        const std::size_t limit =
+            std::min((sector / runLimit + 1) * runLimit, last);
+
+        std::size_t end = sector;
+        while (end < limit && dirtyFatSectors_[end])
+        {
+            if (version_ == FileSystemVersion::Fat12)
+                RepackFat12Sector(end);
+
+            dirtyFatSectors_[end] = false;
+            end++;
         }
+
+        WriteFatSectors(sector,
+                        end - sector,
+                        FatBytes(sector * bpb_.BytesPerSector));
+
+        sector = end;
     }
-    break;
+}
+
+void Fatfs::FileAllocationTable::Implementation::FlushFat()
+{
+    FlushFatSectors(0, dirtyFatSectors_.size());
+}
+
+void Fatfs::FileAllocationTable::Implementation::ReadFsInfo()
+{
+    fsInfoSector_ = bpb_.Offset36.Fat32.FsInfo;
+    if (fsInfoSector_ == 0 || fsInfoSector_ == 0xFFFF ||
+        fsInfoSector_ >= bpb_.ReservedSectors)
+    {
+        fsInfoSector_ = 0;
+        return;
     }
 
-    return 0;
+    Structures::FsInfoSector fsInfo{};
+    fstream_.seekg(fsInfoSector_ * bpb_.BytesPerSector);
+    fstream_.read(reinterpret_cast<char *>(&fsInfo), sizeof fsInfo);
+
+    if (fsInfo.LeadSignature != 0x41615252 ||
+        fsInfo.StructSignature != 0x61417272 ||
+        fsInfo.TrailSignature != 0xAA550000)
+    {
+        fsInfoSector_ = 0;
+        return;
+    }
+
+    // both fields are only hints; anything out of range is treated as
+    // unknown and recomputed by a scan when first needed
+    if (fsInfo.FreeClusterCount <= totalDevClusters_)
+        freeClusterCount_ = fsInfo.FreeClusterCount;
+
+    if (fsInfo.NextFreeCluster >= 2 && fsInfo.NextFreeCluster < fatEntryCount_)
+        nextFreeHint_ = fsInfo.NextFreeCluster;
 }
 
-std::vector<Fatfs::Structures::DirectoryEntry>
-Fatfs::FileAllocationTable::Implementation::ReadRawDirectory(
-    std::string_view path)
+void Fatfs::FileAllocationTable::Implementation::FlushFsInfo()
+{
+    if (fsInfoSector_ == 0 || !fsInfoDirty_)
+        return;
+
+    Structures::FsInfoSector fsInfo{};
+    ReadMetadata(fsInfoSector_ * bpb_.BytesPerSector, &fsInfo, sizeof fsInfo);
+
+    fsInfo.FreeClusterCount =
+        freeClusterCount_ ? *freeClusterCount_ : 0xFFFFFFFF;
+    fsInfo.NextFreeCluster = nextFreeHint_;
+
+    WriteMetadata(fsInfoSector_ * bpb_.BytesPerSector, &fsInfo, sizeof fsInfo);
+
+    fsInfoDirty_ = false;
+}
+
+void Fatfs::FileAllocationTable::Implementation::Flush()
+{
+    // the FAT stays dirty in memory until the group is complete
+    if (++pendingOperations_ < operationsPerFlush_)
+        return;
+
+    Commit();
+}
+
+void Fatfs::FileAllocationTable::Implementation::Commit()
+{
+    FlushFat();
+    FlushFsInfo();
+
+    if (!journal_ || pendingSectors_.empty())
+    {
+        fstream_.flush();
+        pendingFreeClusters_.clear();
+        pendingOperations_ = 0;
+        return;
+    }
+
+    // data first, so that committed metadata never points at clusters whose
+    // contents didn't make it
+    fstream_.flush();
+    journal_->SyncVolume();
+
+    journal_->Commit(pendingSectors_);
+
+    // the group is durable; write it in place and retire the record
+    for (const auto &[offset, data] : pendingSectors_)
+    {
+        fstream_.seekp(offset);
+        fstream_.write(reinterpret_cast<const char *>(data.data()),
+                       data.size());
+    }
+
+    fstream_.flush();
+    journal_->SyncVolume();
+    journal_->Checkpoint();
+
+    pendingSectors_.clear();
+    pendingFreeClusters_.clear();
+    pendingOperations_ = 0;
+}
+
+void Fatfs::FileAllocationTable::Implementation::Sync()
+{
+    Commit();
+}
+
+void Fatfs::FileAllocationTable::Implementation::ReadMetadata(
+    std::size_t offset,
+    void       *data,
+    std::size_t size)
+{
+    fstream_.seekg(offset);
+    fstream_.read(static_cast<char *>(data), size);
+
+    if (pendingSectors_.empty())
+        return;
+
+    // overlay sectors that were written but not committed yet
+    const std::size_t sectorSize = bpb_.BytesPerSector;
+    const std::size_t first      = offset / sectorSize * sectorSize;
+
+    for (auto it = pendingSectors_.lower_bound(first);
+         it != pendingSectors_.end() && it->first < offset + size;
+         ++it)
+    {
+        const std::size_t begin = std::max(offset, it->first);
+        const std::size_t end   = std::min(offset + size, it->first + sectorSize);
+
+        std::memcpy(static_cast<std::byte *>(data) + (begin - offset),
+                    it->second.data() + (begin - it->first),
+                    end - begin);
+    }
+}
+
+void Fatfs::FileAllocationTable::Implementation::WriteMetadata(
+    std::size_t offset,
+    const void *data,
+    std::size_t size)
 {
-    std::vector<Structures::DirectoryEntry>
-        rawDir{}; // "raw" directory (as it is on disk)
+    if (!journal_)
+    {
+        fstream_.seekp(offset);
+        fstream_.write(static_cast<const char *>(data), size);
+        return;
+    }
 
-    // if root path is given then return root directory
-    if (Utilities::String::TrimString(path) == "\\")
+    // stage whole sectors until the group is committed
+    const std::size_t sectorSize = bpb_.BytesPerSector;
+
+    for (std::size_t position = offset; position < offset + size;)
     {
-        if (version_ != FileSystemVersion::Fat32)
+        const std::size_t sector = position / sectorSize * sectorSize;
+        const std::size_t end    = std::min(offset + size, sector + sectorSize);
+
+        auto [it, inserted] = pendingSectors_.try_emplace(sector);
+        if (inserted)
         {
-            // root directory in FAT12 and FAT16 has a fixed size and is located
-            // at a fixed offset (directly after the FAT table)
-            rawDir.resize(bpb_.RootDirEntries *
-                          sizeof(Structures::DirectoryEntry));
+            it->second.resize(sectorSize);
 
-            fstream_.seekg(firstRootDirSector_ * bpb_.BytesPerSector);
-            fstream_.read(reinterpret_cast<char *>(rawDir.data()),
-                          rawDir.size());
+            fstream_.seekg(sector);
+            fstream_.read(reinterpret_cast<char *>(it->second.data()),
+                          sectorSize);
         }
-        else
-        {
-            const std::size_t entriesPerCluster =
-                bpb_.SectorsPerCluster * bpb_.BytesPerSector /
-                sizeof(Structures::DirectoryEntry); // just for readability
 
-            std::size_t cluster = bpb_.Offset36.Fat32.FirstRootDirCluster;
-            std::size_t newSize = 0;
+        std::memcpy(it->second.data() + (position - sector),
+                    static_cast<const std::byte *>(data) + (position - offset),
+                    end - position);
 
-            do
-            {
-                // seek to position of cluster in disk
-                fstream_.seekg(ConvertClusterToSector(cluster) *
-                               bpb_.BytesPerSector);
+        position = end;
+    }
+}
+
+std::size_t Fatfs::FileAllocationTable::Implementation::CountFreeClusters()
+{
+    std::size_t count = 0;
+
+    for (std::size_t i = 2; i < fatEntryCount_; i++)
+    {
+        if (ExtractCluster(i) == 0)
+            count++;
+    }
 
-                newSize += entriesPerCluster;
-                rawDir.resize(newSize);
+    return count;
+}
 
-                // read cluster
-                fstream_.read(reinterpret_cast<char *>(rawDir.data() + newSize -
-                                                       entriesPerCluster),
-                              sizeof(Structures::DirectoryEntry) *
-                                  entriesPerCluster);
+std::vector<std::size_t>
+Fatfs::FileAllocationTable::Implementation::ExtractClusterChain(
+    size_t startCluster)
+{
+    std::vector<std::size_t> chain;
+    std::size_t              cluster = startCluster;
 
-                // get next cluster index
-                cluster = ExtractCluster(cluster);
-            } while (cluster < 0x0FFFFFF0);
-            // indices greater than 0x0FFFFFF0 are either damaged or indicates
-            // the last cluster in the chain
+    // a corrupt FAT may point outside itself or loop; no valid chain is
+    // longer than the FAT has clusters
+    do
+    {
+        if (cluster < 2 || cluster >= fatEntryCount_ ||
+            chain.size() >= fatEntryCount_ - 2)
+        {
+            throw Errors::FileSystemError{"broken cluster chain starting at " +
+                                          std::to_string(startCluster)};
         }
+
+        chain.emplace_back(cluster);
+        cluster = ExtractCluster(cluster);
+    } while (!IsEndOfClusterChain(cluster));
+
+    return chain;
+}
+
+std::size_t Fatfs::FileAllocationTable::Implementation::GetNextFreeCluster()
+{
+    return GetNextFreeCluster(nextFreeHint_ - 1);
+}
+
+std::size_t Fatfs::FileAllocationTable::Implementation::GetNextFreeCluster(
+    size_t startCluster)
+{
+    if (freeClusterCount_ == 0)
+        return 0;
+
+    // search forward from the start cluster, then wrap around
+    for (std::size_t i = startCluster + 1; i < fatEntryCount_; i++)
+    {
+        if (IsClusterFree(i))
+            return i;
     }
-    else
+
+    for (std::size_t i = 2; i < startCluster && i < fatEntryCount_; i++)
     {
-        const std::vector<std::byte> contents = ReadFile(path, true);
+        if (IsClusterFree(i))
+            return i;
+    }
 
-        const std::byte  *ptr = contents.data(); // pointer to contents
-        const std::size_t len =
-            contents.size() /
-            sizeof(Structures::DirectoryEntry); // amount of entries
-        const auto arr = reinterpret_cast<const Structures::DirectoryEntry *>(
-            ptr); // cast to
-        // array of
-        // DirectoryEntry
+    return 0;
+}
 
-        rawDir.assign(arr, arr + len);
-    }
+std::pmr::vector<Fatfs::Structures::DirectoryEntry>
+Fatfs::FileAllocationTable::Implementation::ReadRawDirectory(
+    std::string_view           path,
+    std::pmr::memory_resource *resource)
+{
+    std::pmr::vector<Structures::DirectoryEntry> rawDir{
+        resource}; // "raw" directory (as it is on disk)
 
-    // get iterator to first null entry
-    const auto it = std::find_if(rawDir.begin(),
-                                 rawDir.end(),
-                                 [](const Structures::DirectoryEntry &x)
-                                 {
-                                     return x.Name[0] == '\0';
-                                 });
+    DirectoryCursor cursor{.Buffer = std::pmr::vector<std::byte>{resource}};
+    ReopenDirectory(cursor, path);
 
-    // remove null entries
-    rawDir.erase(it, rawDir.end());
+    for (auto entries = ReadNextDirectoryCluster(cursor); !entries.empty();
+         entries      = ReadNextDirectoryCluster(cursor))
+    {
+        rawDir.insert(rawDir.end(), entries.begin(), entries.end());
+    }
 
     return rawDir;
 }
@@ -843,6 +2839,20 @@ std::size_t Fatfs::FileAllocationTable::Implementation::ConvertClusterToSector(
     return (cluster - 2) * bpb_.SectorsPerCluster + firstDataRegionSector_;
 }
 
+bool Fatfs::FileAllocationTable::Implementation::IsClusterFree(
+    std::size_t cluster)
+{
+    return ExtractCluster(cluster) == 0 && !pendingFreeClusters_.contains(cluster);
+}
+
+bool Fatfs::FileAllocationTable::Implementation::IsRootCluster(
+    std::size_t cluster) const
+{
+    return cluster == 0 ||
+           (version_ == FileSystemVersion::Fat32 &&
+            cluster == bpb_.Offset36.Fat32.FirstRootDirCluster);
+}
+
 bool Fatfs::FileAllocationTable::Implementation::IsEndOfClusterChain(
     size_t cluster) const
 {
@@ -0,0 +1,76 @@
+#include "fatfs/FileAllocationTable.hpp"
+#include "fatfs/FileAllocationTable.impl.hpp"
+#include "fatfs/Helpers.hpp"
+#include "fatfs/Structures.hpp"
+
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <vector>
+
+void Fatfs::FileAllocationTable::Implementation::Find(
+    std::string_view    directory,
+    std::string_view    pattern,
+    const FindOptions  &options,
+    const FindCallback &callback)
+{
+    using namespace Structures;
+
+    const Helpers::Path::FatName mask =
+        Helpers::Path::ConvertPatternToFatMask(pattern);
+
+    std::vector<Walker> walkers = PrepareWalkers();
+
+    std::mutex callbackMutex;
+    bool       stopped = false; // the callback asked to stop; under the mutex
+
+    WalkTree(
+        walkers,
+        directory,
+        [&](Walker &walker, const PendingDirectory &pending, const auto &descend)
+        {
+            ScanDirectory(
+                walker.Reader,
+                pending.FirstCluster,
+                fatEntryCount_,
+                walker.Buffer,
+                [&](const DirectoryEntry &entry, std::size_t)
+                {
+                    const std::string_view name{
+                        reinterpret_cast<const char *>(entry.Name),
+                        std::size(entry.Name) + std::size(entry.Extension)};
+
+                    const bool isDirectory =
+                        (entry.Attributes & RawAttributes::Directory) != 0;
+
+                    if (isDirectory)
+                        descend(entry);
+
+                    if ((options.Type == EntryType::File && isDirectory) ||
+                        (options.Type == EntryType::Directory && !isDirectory))
+                        return true;
+
+                    const std::size_t size = isDirectory ? 0 : entry.FileSize;
+                    if (size < options.MinSize || size > options.MaxSize ||
+                        !Helpers::Path::MatchesFatMask(mask, name))
+                        return true;
+
+                    // the path is only built for matches
+                    const std::string path =
+                        pending.Path + "\\" +
+                        Helpers::Path::ConvertFatPathToLongPath(name);
+
+                    const std::lock_guard lock{callbackMutex};
+
+                    if (stopped)
+                        return false;
+                    if (!callback(path, DirectoryEntryView{entry, utcOffset_}))
+                        stopped = true;
+
+                    return true;
+                });
+
+            const std::lock_guard lock{callbackMutex};
+            return !stopped;
+        });
+}
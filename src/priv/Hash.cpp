@@ -0,0 +1,233 @@
+#include "fatfs/Hash.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <string>
+
+namespace
+{
+
+// slicing-by-8 tables for the reflected Castagnoli polynomial
+constexpr std::array<std::array<std::uint32_t, 256>, 8> MakeCrc32cTables()
+{
+    std::array<std::array<std::uint32_t, 256>, 8> tables{};
+
+    for (std::uint32_t i = 0; i < 256; i++)
+    {
+        std::uint32_t crc = i;
+        for (int bit = 0; bit < 8; bit++)
+            crc = crc >> 1 ^ (crc & 1 ? 0x82F63B78 : 0);
+
+        tables[0][i] = crc;
+    }
+
+    for (std::size_t t = 1; t < 8; t++)
+    {
+        for (std::size_t i = 0; i < 256; i++)
+            tables[t][i] = tables[t - 1][i] >> 8 ^ tables[0][tables[t - 1][i] & 0xFF];
+    }
+
+    return tables;
+}
+
+constexpr auto kCrc32cTables = MakeCrc32cTables();
+
+std::uint32_t Crc32cSoftware(std::uint32_t crc, const std::byte *data, std::size_t size)
+{
+    const auto &t = kCrc32cTables;
+
+    for (; size >= 8; data += 8, size -= 8)
+    {
+        std::uint64_t word{};
+        std::memcpy(&word, data, sizeof word);
+
+        if constexpr (std::endian::native == std::endian::big)
+            word = __builtin_bswap64(word);
+
+        word ^= crc;
+
+        crc = t[7][word & 0xFF] ^ t[6][word >> 8 & 0xFF] ^ t[5][word >> 16 & 0xFF] ^
+              t[4][word >> 24 & 0xFF] ^ t[3][word >> 32 & 0xFF] ^
+              t[2][word >> 40 & 0xFF] ^ t[1][word >> 48 & 0xFF] ^
+              t[0][word >> 56];
+    }
+
+    for (; size > 0; data++, size--)
+        crc = crc >> 8 ^ t[0][(crc ^ static_cast<std::uint8_t>(*data)) & 0xFF];
+
+    return crc;
+}
+
+#if defined(__x86_64__)
+
+__attribute__((target("sse4.2"))) std::uint32_t
+Crc32cHardware(std::uint32_t crc, const std::byte *data, std::size_t size)
+{
+    std::uint64_t crc64 = crc;
+
+    for (; size >= 8; data += 8, size -= 8)
+    {
+        std::uint64_t word{};
+        std::memcpy(&word, data, sizeof word);
+
+        crc64 = __builtin_ia32_crc32di(crc64, word);
+    }
+
+    crc = static_cast<std::uint32_t>(crc64);
+
+    for (; size > 0; data++, size--)
+        crc = __builtin_ia32_crc32qi(crc, static_cast<std::uint8_t>(*data));
+
+    return crc;
+}
+
+const bool kHasCrc32cInstruction = __builtin_cpu_supports("sse4.2");
+
+#endif
+
+constexpr std::array<std::uint32_t, 64> kSha256RoundConstants{
+    0x428A2F98, 0x71374491, 0xB5C0FBCF, 0xE9B5DBA5, 0x3956C25B, 0x59F111F1,
+    0x923F82A4, 0xAB1C5ED5, 0xD807AA98, 0x12835B01, 0x243185BE, 0x550C7DC3,
+    0x72BE5D74, 0x80DEB1FE, 0x9BDC06A7, 0xC19BF174, 0xE49B69C1, 0xEFBE4786,
+    0x0FC19DC6, 0x240CA1CC, 0x2DE92C6F, 0x4A7484AA, 0x5CB0A9DC, 0x76F988DA,
+    0x983E5152, 0xA831C66D, 0xB00327C8, 0xBF597FC7, 0xC6E00BF3, 0xD5A79147,
+    0x06CA6351, 0x14292967, 0x27B70A85, 0x2E1B2138, 0x4D2C6DFC, 0x53380D13,
+    0x650A7354, 0x766A0ABB, 0x81C2C92E, 0x92722C85, 0xA2BFE8A1, 0xA81A664B,
+    0xC24B8B70, 0xC76C51A3, 0xD192E819, 0xD6990624, 0xF40E3585, 0x106AA070,
+    0x19A4C116, 0x1E376C08, 0x2748774C, 0x34B0BCB5, 0x391C0CB3, 0x4ED8AA4A,
+    0x5B9CCA4F, 0x682E6FF3, 0x748F82EE, 0x78A5636F, 0x84C87814, 0x8CC70208,
+    0x90BEFFFA, 0xA4506CEB, 0xBEF9A3F7, 0xC67178F2};
+
+} // namespace
+
+void Fatfs::Hash::Crc32c::Update(std::span<const std::byte> data)
+{
+#if defined(__x86_64__)
+    if (kHasCrc32cInstruction)
+    {
+        state_ = Crc32cHardware(state_, data.data(), data.size());
+        return;
+    }
+#endif
+
+    state_ = Crc32cSoftware(state_, data.data(), data.size());
+}
+
+std::uint32_t Fatfs::Hash::Crc32c::Value() const
+{
+    return ~state_;
+}
+
+void Fatfs::Hash::Sha256::Update(std::span<const std::byte> data)
+{
+    length_ += data.size();
+
+    // top up a partial block first
+    if (buffered_ > 0)
+    {
+        const std::size_t count = std::min(data.size(), block_.size() - buffered_);
+        std::memcpy(block_.data() + buffered_, data.data(), count);
+
+        buffered_ += count;
+        data = data.subspan(count);
+
+        if (buffered_ < block_.size())
+            return;
+
+        Compress(block_.data());
+        buffered_ = 0;
+    }
+
+    for (; data.size() >= block_.size(); data = data.subspan(block_.size()))
+        Compress(data.data());
+
+    std::memcpy(block_.data(), data.data(), data.size());
+    buffered_ = data.size();
+}
+
+std::string Fatfs::Hash::Sha256::Finish()
+{
+    const std::uint64_t bits = length_ * 8;
+
+    // 0x80, zeros up to 56 bytes into a block, then the length big-endian
+    std::array<std::byte, 72> padding{};
+    padding[0] = std::byte{0x80};
+
+    const std::size_t zeros = (buffered_ < 56 ? 56 : 120) - buffered_;
+    for (std::size_t i = 0; i < 8; i++)
+        padding[zeros + i] = static_cast<std::byte>(bits >> (56 - i * 8));
+
+    Update({padding.data(), zeros + 8});
+
+    constexpr char kDigits[] = "0123456789abcdef";
+
+    std::string digest;
+    digest.reserve(64);
+
+    for (const std::uint32_t word : state_)
+    {
+        for (int shift = 28; shift >= 0; shift -= 4)
+            digest += kDigits[word >> shift & 0xF];
+    }
+
+    return digest;
+}
+
+void Fatfs::Hash::Sha256::Compress(const std::byte *block)
+{
+    std::array<std::uint32_t, 64> w{};
+
+    for (std::size_t i = 0; i < 16; i++)
+    {
+        w[i] = static_cast<std::uint32_t>(block[i * 4]) << 24 |
+               static_cast<std::uint32_t>(block[i * 4 + 1]) << 16 |
+               static_cast<std::uint32_t>(block[i * 4 + 2]) << 8 |
+               static_cast<std::uint32_t>(block[i * 4 + 3]);
+    }
+
+    for (std::size_t i = 16; i < 64; i++)
+    {
+        const std::uint32_t s0 =
+            std::rotr(w[i - 15], 7) ^ std::rotr(w[i - 15], 18) ^ w[i - 15] >> 3;
+        const std::uint32_t s1 =
+            std::rotr(w[i - 2], 17) ^ std::rotr(w[i - 2], 19) ^ w[i - 2] >> 10;
+
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    auto [a, b, c, d, e, f, g, h] = state_;
+
+    for (std::size_t i = 0; i < 64; i++)
+    {
+        const std::uint32_t s1 = std::rotr(e, 6) ^ std::rotr(e, 11) ^ std::rotr(e, 25);
+        const std::uint32_t choice = (e & f) ^ (~e & g);
+        const std::uint32_t t1 = h + s1 + choice + kSha256RoundConstants[i] + w[i];
+
+        const std::uint32_t s0 = std::rotr(a, 2) ^ std::rotr(a, 13) ^ std::rotr(a, 22);
+        const std::uint32_t majority = (a & b) ^ (a & c) ^ (b & c);
+        const std::uint32_t t2       = s0 + majority;
+
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+
+    state_[0] += a;
+    state_[1] += b;
+    state_[2] += c;
+    state_[3] += d;
+    state_[4] += e;
+    state_[5] += f;
+    state_[6] += g;
+    state_[7] += h;
+}
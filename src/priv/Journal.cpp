@@ -0,0 +1,237 @@
+#include "fatfs/Journal.hpp"
+
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace
+{
+
+constexpr std::uint32_t kRecordMagic = 0x4C4E4A46; // "FJNL"
+
+// precedes the sectors of a record; the record ends with the CRC-32 of the
+// header and all sectors
+struct RecordHeader
+{
+    std::uint32_t Magic;
+    std::uint32_t Sequence;
+    std::uint32_t SectorSize;
+    std::uint32_t SectorCount;
+};
+
+constexpr auto kCrcTable = []
+{
+    std::array<std::uint32_t, 256> table{};
+
+    for (std::uint32_t i = 0; i < 256; i++)
+    {
+        std::uint32_t crc = i;
+        for (int bit = 0; bit < 8; bit++)
+            crc = crc & 1 ? crc >> 1 ^ 0xEDB88320 : crc >> 1;
+
+        table[i] = crc;
+    }
+
+    return table;
+}();
+
+std::uint32_t UpdateCrc(std::uint32_t crc, const void *data, std::size_t size)
+{
+    const auto *bytes = static_cast<const std::uint8_t *>(data);
+
+    for (std::size_t i = 0; i < size; i++)
+        crc = kCrcTable[(crc ^ bytes[i]) & 0xFF] ^ crc >> 8;
+
+    return crc;
+}
+
+void WriteAll(int fd, const void *data, std::size_t size)
+{
+    const auto *bytes = static_cast<const char *>(data);
+
+    while (size > 0)
+    {
+        const ssize_t written = ::write(fd, bytes, size);
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written < 0)
+            throw std::runtime_error{std::string{"failed to write to journal: "} +
+                                     std::strerror(errno)};
+
+        bytes += written;
+        size -= written;
+    }
+}
+
+} // namespace
+
+Fatfs::Journal::Journal(std::string_view path, std::string_view volumePath)
+    : path_(path)
+{
+    fd_ = ::open(path_.c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+    if (fd_ < 0)
+        throw std::runtime_error{"failed to open journal " + path_};
+
+    // only used to sync the volume; the writes go through the caller's
+    // stream, which shares the same file
+    volumeFd_ = ::open(std::string{volumePath}.c_str(), O_RDONLY);
+    if (volumeFd_ < 0)
+    {
+        ::close(fd_);
+        throw std::runtime_error{"failed to open file " +
+                                 std::string{volumePath}};
+    }
+}
+
+Fatfs::Journal::~Journal()
+{
+    ::close(volumeFd_);
+    ::close(fd_);
+}
+
+std::size_t Fatfs::Journal::Replay(std::fstream &volume)
+{
+    std::ifstream stream{path_, std::ios::binary};
+    const std::vector<char> journal{std::istreambuf_iterator<char>{stream},
+                                    std::istreambuf_iterator<char>{}};
+
+    std::size_t applied  = 0;
+    std::size_t position = 0;
+
+    // stop at the first record that is torn or doesn't check out; nothing
+    // after it can have been committed
+    while (position + sizeof(RecordHeader) <= journal.size())
+    {
+        RecordHeader header{};
+        std::memcpy(&header, journal.data() + position, sizeof header);
+
+        const std::size_t entrySize = sizeof(std::uint64_t) + header.SectorSize;
+        const std::size_t bodySize  = header.SectorCount * entrySize;
+
+        if (header.Magic != kRecordMagic || header.SectorSize == 0 ||
+            bodySize / entrySize != header.SectorCount ||
+            journal.size() - position <
+                sizeof header + bodySize + sizeof(std::uint32_t))
+        {
+            break;
+        }
+
+        std::uint32_t checksum{};
+        std::memcpy(&checksum,
+                    journal.data() + position + sizeof header + bodySize,
+                    sizeof checksum);
+
+        if (~UpdateCrc(~0u,
+                       journal.data() + position,
+                       sizeof header + bodySize) != checksum)
+        {
+            break;
+        }
+
+        const char *entry = journal.data() + position + sizeof header;
+        for (std::size_t i = 0; i < header.SectorCount; i++, entry += entrySize)
+        {
+            std::uint64_t offset{};
+            std::memcpy(&offset, entry, sizeof offset);
+
+            volume.seekp(offset);
+            volume.write(entry + sizeof offset, header.SectorSize);
+        }
+
+        sequence_ = header.Sequence + 1;
+        position += sizeof header + bodySize + sizeof checksum;
+        applied++;
+    }
+
+    if (applied > 0)
+    {
+        volume.flush();
+        SyncVolume();
+    }
+
+    // whatever is left is either replayed or garbage
+    Checkpoint();
+
+    return applied;
+}
+
+void Fatfs::Journal::Commit(const Sectors &sectors)
+{
+    if (broken_)
+    {
+        throw std::runtime_error{"journal " + path_ +
+                                 " is unusable after a failed write"};
+    }
+
+    if (sectors.empty())
+        return;
+
+    // where this record starts, to cut it off again if it doesn't make it
+    const off_t start = ::lseek(fd_, 0, SEEK_END);
+    if (start < 0)
+        throw std::runtime_error{"failed to seek in journal " + path_};
+
+    const RecordHeader header{
+        kRecordMagic,
+        sequence_++,
+        static_cast<std::uint32_t>(sectors.begin()->second.size()),
+        static_cast<std::uint32_t>(sectors.size())};
+
+    // build the record in one buffer so that it goes out in a single write
+    std::vector<char> record(sizeof header);
+    std::memcpy(record.data(), &header, sizeof header);
+
+    for (const auto &[offset, data] : sectors)
+    {
+        const std::uint64_t offset64 = offset;
+        const std::size_t   at       = record.size();
+
+        record.resize(at + sizeof offset64 + data.size());
+        std::memcpy(record.data() + at, &offset64, sizeof offset64);
+        std::memcpy(record.data() + at + sizeof offset64,
+                    data.data(),
+                    data.size());
+    }
+
+    const std::uint32_t checksum =
+        ~UpdateCrc(~0u, record.data(), record.size());
+    record.resize(record.size() + sizeof checksum);
+    std::memcpy(record.data() + record.size() - sizeof checksum,
+                &checksum,
+                sizeof checksum);
+
+    try
+    {
+        WriteAll(fd_, record.data(), record.size());
+
+        if (::fdatasync(fd_) != 0)
+            throw std::runtime_error{"failed to sync journal"};
+    }
+    catch (...)
+    {
+        // a torn record would stop replay before any record appended after
+        // it; if it can't be cut off, refuse to append more
+        sequence_--;
+        if (::ftruncate(fd_, start) != 0 || ::fdatasync(fd_) != 0)
+            broken_ = true;
+
+        throw;
+    }
+}
+
+void Fatfs::Journal::Checkpoint()
+{
+    if (::ftruncate(fd_, 0) != 0 || ::fdatasync(fd_) != 0)
+        throw std::runtime_error{"failed to truncate journal"};
+}
+
+void Fatfs::Journal::SyncVolume()
+{
+    if (::fdatasync(volumeFd_) != 0)
+        throw std::runtime_error{"failed to sync volume"};
+}
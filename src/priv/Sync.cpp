@@ -0,0 +1,286 @@
+#include "fatfs/Errors.hpp"
+#include "fatfs/FileAllocationTable.hpp"
+#include "fatfs/FileAllocationTable.impl.hpp"
+#include "fatfs/Helpers.hpp"
+#include "fatfs/Structures.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+// host names have to survive the trip through 8.3 unchanged; anything longer
+// would be cut short and could collide with another name. a name needs a base,
+// too: ".git" would become an entry with nothing but an extension
+bool FitsFatName(const std::string &name, const Fatfs::Helpers::Path::FatName &fatName)
+{
+    if (fatName[0] == ' ')
+        return false;
+
+    const std::string converted =
+        Fatfs::Helpers::Path::ConvertFatPathToLongPath({fatName.data(), fatName.size()});
+
+    return std::equal(converted.begin(),
+                      converted.end(),
+                      name.begin(),
+                      name.end(),
+                      [](char a, char b)
+                      {
+                          return a == std::toupper(static_cast<unsigned char>(b));
+                      });
+}
+
+} // namespace
+
+Fatfs::SyncReport
+Fatfs::FileAllocationTable::Implementation::SyncFrom(std::string_view hostDirectory,
+                                                     std::string_view directory)
+{
+    const std::filesystem::path host{hostDirectory};
+    if (!std::filesystem::is_directory(host))
+    {
+        throw Errors::DirectoryNotFoundError{"host directory " + host.string() +
+                                             " not found"};
+    }
+
+    // throws if the directory isn't on the volume
+    static_cast<void>(OpenDirectory(directory));
+
+    SyncReport report{};
+
+    // with a journal, one group for the whole refresh, however many files it
+    // touches; without one, every change is written out as it is made
+    const std::size_t operationsPerFlush = operationsPerFlush_;
+    if (journal_)
+        operationsPerFlush_ = std::numeric_limits<std::size_t>::max();
+
+    try
+    {
+        SyncDirectory(host, std::string{directory}, report);
+    }
+    catch (...)
+    {
+        // what was done so far is consistent; keep it
+        operationsPerFlush_ = operationsPerFlush;
+        Commit();
+        throw;
+    }
+
+    operationsPerFlush_ = operationsPerFlush;
+    Commit();
+
+    return report;
+}
+
+void Fatfs::FileAllocationTable::Implementation::SyncDirectory(
+    const std::filesystem::path &host,
+    const std::string           &path,
+    SyncReport                  &report)
+{
+    using namespace Structures;
+
+    // what the volume has; whatever is left over has gone from the host
+    std::map<Helpers::Path::FatName, DirectoryEntry> existing;
+    {
+        DirectoryCursor cursor = OpenDirectory(path);
+        while (const DirectoryEntry *entry = NextDirectoryEntry(cursor))
+        {
+            if (entry->Name[0] == '.')
+                continue;
+
+            Helpers::Path::FatName name{};
+            std::memcpy(name.data(), entry->Name, name.size());
+
+            existing.emplace(name, *entry);
+        }
+    }
+
+    std::string prefix = path;
+    if (prefix.empty() || prefix.back() != '\\')
+        prefix += '\\';
+
+    // in name order, so that repeated runs lay out new entries the same way
+    std::vector<std::filesystem::directory_entry> hostEntries{
+        std::filesystem::directory_iterator{host}, {}};
+    std::sort(hostEntries.begin(), hostEntries.end());
+
+    for (const std::filesystem::directory_entry &hostEntry : hostEntries)
+    {
+        const bool isDirectory = hostEntry.is_directory();
+        if (!isDirectory && !hostEntry.is_regular_file())
+            continue;
+
+        const std::string            name = hostEntry.path().filename().string();
+        const Helpers::Path::FatName fatName =
+            Helpers::Path::ConvertLongNameToFatName(name);
+
+        // left out rather than failing halfway through the refresh
+        if (!FitsFatName(name, fatName))
+        {
+            report.Skipped.push_back(hostEntry.path().string());
+            continue;
+        }
+
+        const std::string entryPath = prefix + name;
+
+        std::optional<DirectoryEntry> current;
+        if (const auto it = existing.find(fatName); it != existing.end())
+        {
+            current = it->second;
+            existing.erase(it);
+        }
+
+        // a file that became a directory or the other way around
+        if (current &&
+            ((current->Attributes & RawAttributes::Directory) != 0) != isDirectory)
+        {
+            RemoveEntry(entryPath, true, false);
+            report.Deleted++;
+            current.reset();
+        }
+
+        if (isDirectory)
+        {
+            if (!current)
+            {
+                CreateDirectory(entryPath);
+                report.Created++;
+            }
+
+            SyncDirectory(hostEntry.path(), entryPath, report);
+            continue;
+        }
+
+        const std::size_t size = hostEntry.file_size();
+        const auto        modified =
+            std::chrono::time_point_cast<std::chrono::system_clock::duration>(
+                std::chrono::file_clock::to_sys(hostEntry.last_write_time()));
+
+        // compared as stored, i.e. in two second steps
+        if (current && current->FileSize == size)
+        {
+            const auto [time, date] =
+                Helpers::Time::ConvertUnixTimeToFatTime(modified, utcOffset_);
+
+            if (std::memcmp(&current->LastModificationTime, &time, sizeof time) == 0 &&
+                std::memcmp(&current->LastModificationDate, &date, sizeof date) == 0)
+            {
+                report.Unchanged++;
+                continue;
+            }
+        }
+
+        if (current)
+        {
+            EntryLocation location = FindFile(entryPath);
+
+            SyncFile(hostEntry.path(), size, location);
+            SetModificationTime(location, modified);
+
+            report.Updated++;
+        }
+        else
+        {
+            std::ifstream input{hostEntry.path(), std::ios::binary};
+            if (!input.is_open())
+                throw std::runtime_error{"failed to open file " +
+                                         hostEntry.path().string()};
+
+            CreateFile(entryPath, input, size);
+
+            EntryLocation location = FindFile(entryPath);
+            SetModificationTime(location, modified);
+
+            report.Created++;
+        }
+    }
+
+    for (const auto &[name, entry] : existing)
+    {
+        RemoveEntry(prefix + Helpers::Path::ConvertFatPathToLongPath(
+                                 {name.data(), name.size()}),
+                    true,
+                    false);
+        report.Deleted++;
+    }
+}
+
+void Fatfs::FileAllocationTable::Implementation::SyncFile(
+    const std::filesystem::path &host,
+    std::size_t                  size,
+    EntryLocation               &location)
+{
+    constexpr std::size_t kChunkSize   = 1024 * 1024;
+    constexpr std::size_t kMaxFileSize = 0xFFFFFFFF;
+
+    if (size > kMaxFileSize)
+        throw Errors::FileSystemError{"file would exceed the maximum size"};
+
+    std::ifstream input{host, std::ios::binary};
+    if (!input.is_open())
+        throw std::runtime_error{"failed to open file " + host.string()};
+
+    Structures::DirectoryEntry &entry    = location.Entry;
+    const std::size_t           clusters = ChainLength(entry);
+
+    try
+    {
+        // the existing chain is written over; growth is added as one run
+        // where there is room
+        if (size > 0)
+        {
+            static_cast<void>(ReserveClusters(
+                entry, RoundUp(size, bytesPerCluster_) / bytesPerCluster_, true));
+        }
+
+        std::vector<std::byte> chunk(std::min(kChunkSize, size));
+
+        for (std::size_t offset = 0; offset < size;)
+        {
+            const std::size_t count = std::min(chunk.size(), size - offset);
+
+            if (!input.read(reinterpret_cast<char *>(chunk.data()), count))
+                throw std::runtime_error{"failed to read file " + host.string()};
+
+            WriteAt(location, offset, {chunk.data(), count});
+            offset += count;
+        }
+    }
+    catch (...)
+    {
+        // a grown chain the entry never recorded would be lost
+        ShrinkChain(entry, clusters * bytesPerCluster_);
+        throw;
+    }
+
+    ShrinkChain(entry, size);
+    entry.FileSize = size;
+}
+
+void Fatfs::FileAllocationTable::Implementation::SetModificationTime(
+    EntryLocation                        &location,
+    std::chrono::system_clock::time_point time)
+{
+    const auto [fatTime, fatDate] =
+        Helpers::Time::ConvertUnixTimeToFatTime(time, utcOffset_);
+
+    Structures::DirectoryEntry &entry = location.Entry;
+
+    entry.Attributes |= Structures::RawAttributes::Archive;
+    entry.LastModificationTime = fatTime;
+    entry.LastModificationDate = fatDate;
+    entry.LastAccessDate       = fatDate;
+
+    WriteMetadata(location.Offset, &entry, sizeof entry);
+}
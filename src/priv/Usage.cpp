@@ -0,0 +1,133 @@
+#include "fatfs/FileAllocationTable.hpp"
+#include "fatfs/FileAllocationTable.impl.hpp"
+#include "fatfs/Helpers.hpp"
+#include "fatfs/Structures.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+Fatfs::VolumeUsage Fatfs::FileAllocationTable::Implementation::Usage()
+{
+    VolumeUsage usage{};
+    usage.ClusterSize   = bytesPerCluster_;
+    usage.TotalClusters = fatEntryCount_ - 2;
+
+    for (std::size_t i = 2; i < fatEntryCount_; i++)
+    {
+        const std::size_t next = ExtractCluster(i);
+
+        if (next == 0)
+            usage.FreeClusters++;
+        else if (IsBadCluster(next))
+            usage.BadClusters++;
+        else
+            usage.UsedClusters++;
+    }
+
+    return usage;
+}
+
+std::vector<Fatfs::DirectoryUsage>
+Fatfs::FileAllocationTable::Implementation::DiskUsage(std::string_view directory)
+{
+    using namespace Structures;
+
+    std::vector<Walker> walkers = PrepareWalkers();
+
+    // each directory's own totals first
+    std::mutex                  usageMutex;
+    std::vector<DirectoryUsage> usage;
+
+    // chain length from the FAT alone, stopping at anything invalid
+    const auto countClusters = [&](FatReader &reader, std::size_t cluster)
+    {
+        std::size_t length = 0;
+
+        while (cluster >= 2 && cluster < fatEntryCount_ && length < fatEntryCount_)
+        {
+            length++;
+
+            cluster = reader.Next(cluster);
+            if (IsEndOfClusterChain(cluster))
+                break;
+        }
+
+        return length;
+    };
+
+    WalkTree(
+        walkers,
+        directory,
+        [&](Walker &walker, const PendingDirectory &pending, const auto &descend)
+        {
+            DirectoryUsage own{pending.Path};
+            own.AllocatedBytes =
+                countClusters(walker.Reader, pending.FirstCluster) * bytesPerCluster_;
+
+            ScanDirectory(
+                walker.Reader,
+                pending.FirstCluster,
+                fatEntryCount_,
+                walker.Buffer,
+                [&](const DirectoryEntry &entry, std::size_t)
+                {
+                    // a directory reached twice is only counted once
+                    if ((entry.Attributes & RawAttributes::Directory) != 0)
+                    {
+                        if (descend(entry))
+                            own.Directories++;
+                        return true;
+                    }
+
+                    own.Files++;
+                    own.Bytes += entry.FileSize;
+                    own.AllocatedBytes +=
+                        countClusters(walker.Reader,
+                                      entry.FirstClusterLow |
+                                          entry.FirstClusterHigh << 16) *
+                        bytesPerCluster_;
+                    return true;
+                });
+
+            const std::lock_guard lock{usageMutex};
+            usage.push_back(std::move(own));
+            return true;
+        });
+
+    // a path sorts before everything below it, so going backwards sums every
+    // subtree before it is added to its parent, the path up to the last
+    // backslash
+    std::sort(usage.begin(),
+              usage.end(),
+              [](const DirectoryUsage &a, const DirectoryUsage &b)
+              { return a.Path < b.Path; });
+
+    for (std::size_t i = usage.size(); i-- > 1;)
+    {
+        const std::string_view parentPath =
+            std::string_view{usage[i].Path}.substr(0, usage[i].Path.rfind('\\'));
+
+        const auto parent =
+            std::lower_bound(usage.begin(),
+                             usage.begin() + i,
+                             parentPath,
+                             [](const DirectoryUsage &a, std::string_view path)
+                             { return a.Path < path; });
+
+        parent->Files          += usage[i].Files;
+        parent->Directories    += usage[i].Directories;
+        parent->Bytes          += usage[i].Bytes;
+        parent->AllocatedBytes += usage[i].AllocatedBytes;
+    }
+
+    // the root comes first, with an empty path
+    if (usage.front().Path.empty())
+        usage.front().Path = "\\";
+
+    return usage;
+}
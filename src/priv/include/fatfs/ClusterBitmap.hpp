@@ -0,0 +1,36 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace Fatfs
+{
+// one bit per cluster, set from several threads at once
+class ClusterBitmap
+{
+  public:
+    explicit ClusterBitmap(std::size_t clusters)
+        : words_((clusters + 63) / 64)
+    {
+    }
+
+    // sets the bit; returns whether it was set already
+    bool TestAndSet(std::size_t cluster)
+    {
+        const std::uint64_t bit = std::uint64_t{1} << cluster % 64;
+        return (words_[cluster / 64].fetch_or(bit, std::memory_order_relaxed) &
+                bit) != 0;
+    }
+
+    [[nodiscard]] bool Test(std::size_t cluster) const
+    {
+        const std::uint64_t bit = std::uint64_t{1} << cluster % 64;
+        return (words_[cluster / 64].load(std::memory_order_relaxed) & bit) != 0;
+    }
+
+  private:
+    std::vector<std::atomic<std::uint64_t>> words_;
+};
+} // namespace Fatfs
@@ -1,35 +1,253 @@
 #pragma once
 
+#include "fatfs/ClusterBitmap.hpp"
+#include "fatfs/Helpers.hpp"
+#include "fatfs/Journal.hpp"
 #include "fatfs/Structures.hpp"
+#include "fatfs/WorkQueue.hpp"
 
+#include <chrono>
+#include <concepts>
+#include <cstdint>
+#include <filesystem>
 #include <fstream>
+#include <istream>
+#include <list>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
+namespace Fatfs
+{
+
+template<typename T>
+concept Integral = std::is_integral_v<T> || std::is_enum_v<T>;
+
+template<Integral T, Integral U = T>
+constexpr auto RoundUp(const T num, const U multiple)
+{
+    return (num + multiple - 1) / multiple * multiple;
+}
+
+} // namespace Fatfs
+
+// FAT lookups for threads reading the volume side by side, after a Commit. a
+// paged FAT can't be shared between threads, so each reader then reads the
+// active copy from disk through a page of its own
+struct Fatfs::FatReader
+{
+    static constexpr std::size_t kPageSize = 64 * 1024;
+
+    explicit FatReader(FileAllocationTable::Implementation &volume)
+        : Volume{volume}
+    {
+    }
+
+    FileAllocationTable::Implementation &Volume;
+    std::vector<std::byte>               Page;
+    std::size_t PageIndex = static_cast<std::size_t>(-1);
+
+    [[nodiscard]] std::size_t Next(std::size_t cluster);
+};
+
+// read position in a directory; holds one cluster of entries at a time
+struct Fatfs::DirectoryCursor
+{
+    std::size_t            FirstCluster{}; // identifies the directory
+    std::size_t            Cluster{}; // 0 for the FAT12/FAT16 root directory
+    bool                   Started{};
+    bool                   AtEnd{};
+    bool                   HitEndMarker{}; // as opposed to the chain ending
+    std::pmr::vector<std::byte> Buffer; // entries of the current cluster
+    std::size_t            Entries{}; // in use, up to the end marker
+    std::size_t            Index{};   // next entry for NextDirectoryEntry
+    FatReader             *Reader{}; // if set, a direct read through it
+};
+
+struct Fatfs::EntryLocation
+{
+    Structures::DirectoryEntry Entry;
+    std::size_t                Offset{}; // of the entry in the volume, in bytes
+    std::size_t                Parent{}; // DirectoryCursor::FirstCluster
+};
+
+struct Fatfs::ReadContext::Buffers
+{
+    Buffers(std::pmr::memory_resource *resource, bool direct)
+        : Cursor{.Buffer = std::pmr::vector<std::byte>{resource}},
+          Data{resource},
+          Listing{resource},
+          Times{resource},
+          Direct{direct}
+    {
+    }
+
+    DirectoryCursor                             Cursor; // for path lookups
+    std::pmr::vector<std::byte>                 Data;
+    std::pmr::vector<FileInfo>                  Listing;
+    std::pmr::vector<Helpers::Time::EntryTimes> Times;
+
+    bool                     Direct{};
+    std::optional<FatReader> Reader; // for the volume last read, if Direct
+};
+
 class Fatfs::FileAllocationTable::Implementation
 {
   public:
-    explicit Implementation(std::string_view path);
+    Implementation(std::string_view path, const MountOptions &options);
+    ~Implementation();
 
     std::vector<FileInfo>  ReadDirectory(const std::string_view path);
+    FileInfo               Stat(std::string_view path);
     std::vector<std::byte> ReadFile(const std::string_view path);
+    std::pmr::vector<FileInfo>  ReadDirectory(std::string_view           path,
+                                              std::pmr::memory_resource *resource);
+    std::pmr::vector<std::byte> ReadFile(std::string_view           path,
+                                         std::pmr::memory_resource *resource);
+    std::span<const FileInfo>   ReadDirectory(std::string_view     path,
+                                              ReadContext::Buffers &context);
+    std::span<const std::byte>  ReadFile(std::string_view     path,
+                                         ReadContext::Buffers &context);
+    FileInfo                    Stat(std::string_view     path,
+                                     ReadContext::Buffers &context);
+    std::size_t            Read(std::string_view     path,
+                                std::size_t          offset,
+                                std::span<std::byte> buffer);
+    std::size_t            FileSize(std::string_view path);
+    std::size_t            ReadFileInto(std::string_view     path,
+                                        std::span<std::byte> buffer);
+    std::size_t            ReadFileTo(std::string_view path, int fd);
+
+    void        Find(std::string_view    directory,
+                     std::string_view    pattern,
+                     const FindOptions  &options,
+                     const FindCallback &callback);
+    CheckReport Check(bool repair);
+    VolumeUsage Usage();
+    std::vector<DirectoryUsage> DiskUsage(std::string_view directory);
+    SyncReport SyncFrom(std::string_view hostDirectory, std::string_view directory);
+    std::vector<FileChecksum> Checksum(std::string_view directory, bool sha256);
 
     void CreateFile(std::string_view path, const std::vector<std::byte> &data);
+    void CreateFile(std::string_view           path,
+                    std::istream              &data,
+                    std::optional<std::size_t> size);
     void CreateDirectory(std::string_view path);
 
-    void DeleteEntry(std::string_view path) const;
-    void EraseEntry(std::string_view path) const;
+    void Append(std::string_view path, std::span<const std::byte> data);
+    void Write(std::string_view           path,
+               std::size_t                offset,
+               std::span<const std::byte> data);
+    void Truncate(std::string_view path, std::size_t size);
+    void Preallocate(std::string_view path, std::size_t size, bool keepSize);
+
+    void CompactDirectory(std::string_view path);
+
+    void DeleteEntry(std::string_view path, bool recursive);
+    void EraseEntry(std::string_view path, bool recursive);
+
+    void Move(std::string_view source, std::string_view destination);
+    void Copy(std::string_view source, std::string_view destination);
+
+    void Sync();
 
     [[nodiscard]] FileSystemVersion Version() const;
+    [[nodiscard]] std::size_t       FreeSpace();
+
+    [[nodiscard]] DirectoryCursor OpenDirectory(std::string_view path);
+
+    // next entry that is neither deleted nor part of a long name; nullptr at
+    // the end of the directory
+    const Structures::DirectoryEntry *NextDirectoryEntry(DirectoryCursor &cursor);
+
+    [[nodiscard]] std::chrono::seconds UtcOffset() const;
 
   private:
+    friend struct FatReader;
+
     std::fstream fstream_;
 
+    std::string    volumePath_;
+    int            volumeFd_ = -1; // read-only, opened on first use by VolumeFd
+    std::once_flag volumeFdOpened_;
+
     // do not modify
     // {
     FileSystemVersion version_;
 
     Structures::BiosParameterBlock bpb_{};
-    std::vector<std::byte>         fat_;
+    std::vector<std::byte>         fat_; // empty if the FAT is paged
+
+    // FAT12 entries unpacked to one uint16_t per cluster; fat_ holds the
+    // packed on-disk image and is only brought up to date on flush
+    std::vector<std::uint16_t> fat12_;
+    std::vector<bool>          dirtyFatSectors_;
+
+    // paged FAT: pages of kFatPageSectors sectors, evicted least recently
+    // used first once more than maxFatPages_ are resident
+    struct FatPage
+    {
+        std::vector<std::byte>           Data;
+        std::list<std::size_t>::iterator Position; // in fatPageLru_
+    };
+
+    static constexpr std::size_t kFatPageSectors = 8;
+
+    bool                                    fatPaged_{};
+    std::size_t                             maxFatPages_{};
+    std::unordered_map<std::size_t, FatPage> fatPages_;
+    std::list<std::size_t>                  fatPageLru_;
+
+    std::size_t fatEntryCount_{}; // entries that map an existing cluster
+    std::size_t activeFat_{};     // FAT copy that is read from
+    bool        fatMirroring_{true}; // write every FAT copy on flush
+
+    // free cluster bookkeeping, seeded from FSInfo on FAT32 volumes
+    std::size_t                fsInfoSector_{}; // 0 if there is none
+    bool                       fsInfoDirty_{};
+    std::optional<std::size_t> freeClusterCount_; // empty until counted
+    std::size_t                nextFreeHint_{2};
+
+    std::chrono::seconds utcOffset_{}; // of on-disk timestamps
+
+    std::unique_ptr<Journal> journal_; // null unless mounted with one
+    Journal::Sectors         pendingSectors_; // staged, not committed yet
+    std::size_t              pendingOperations_{}; // since the last flush
+    std::size_t              operationsPerFlush_{};
+    // freed in the open group; not reused until it is written or committed
+    std::unordered_set<std::size_t> pendingFreeClusters_;
+
+    // free slots per directory (keyed by DirectoryCursor::FirstCluster),
+    // built on the first insertion into that directory
+    struct DirectorySlots
+    {
+        std::vector<std::size_t> Deleted; // offsets of 0xE5 slots
+        std::size_t TailCluster{}; // cluster holding the end marker
+        std::size_t TailIndex{};   // slot of the end marker in TailCluster
+        std::size_t LastCluster{}; // of the chain; 0 for the fixed root
+        bool        Full{};        // no end marker, the chain has to grow
+    };
+
+    std::unordered_map<std::size_t, DirectorySlots> directorySlots_;
+
+    // a run of contiguous clusters in a chain
+    struct Extent
+    {
+        std::size_t Index{};   // position of Cluster in the chain
+        std::size_t Cluster{}; // first cluster of the run
+        std::size_t Length{};  // in clusters
+    };
+
+    // file chains (keyed by first cluster) as sorted runs, built on first
+    // access; kept up to date when a chain grows or shrinks and dropped when
+    // it is freed
+    std::unordered_map<std::size_t, std::vector<Extent>> extentMaps_;
 
     std::size_t sectorsPerFat_{};
 
@@ -48,26 +266,344 @@ class Fatfs::FileAllocationTable::Implementation
     std::size_t endOfChainIndicator_;
     // }
 
-    std::vector<std::byte> ReadFile(const std::string_view dirEntry,
-                                    const bool             isDirectory);
+    std::pmr::vector<Structures::DirectoryEntry> ReadRawDirectory(
+        std::string_view           path,
+        std::pmr::memory_resource *resource = std::pmr::get_default_resource());
+
+    // points context's cursor at a reader of this volume if context is
+    // direct, or at none
+    void AttachReader(ReadContext::Buffers &context);
+    // like ReadAt from offset 0, but following the chain through reader and
+    // reading the volume directly; safe beside other direct reads
+    std::size_t ReadDirect(const Structures::DirectoryEntry &entry,
+                           FatReader                        &reader,
+                           std::span<std::byte>              buffer);
+
+    // appends the entries in use from cursor to listing, as FileInfo;
+    // times is scratch space
+    template<typename Listing, typename Times>
+    void ListDirectory(DirectoryCursor &cursor, Listing &listing, Times &times);
+
+    // the root directory yields a synthesized entry at offset 0
+    [[nodiscard]] EntryLocation FindEntry(std::string_view path,
+                                          bool             isDirectory);
+    // the same, reading the directories on the way through cursor's buffer
+    [[nodiscard]] EntryLocation FindEntry(std::string_view path,
+                                          bool             isDirectory,
+                                          DirectoryCursor &cursor);
+
+    [[nodiscard]] std::size_t
+    GetEntryOffset(const DirectoryCursor            &cursor,
+                   const Structures::DirectoryEntry *entry) const;
 
-    std::vector<Structures::DirectoryEntry>
-    ReadRawDirectory(std::string_view path);
+    [[nodiscard]] DirectoryCursor OpenDirectory(std::size_t firstCluster);
+    // point cursor at the start of another directory, keeping its buffer
+    void ReopenDirectory(DirectoryCursor &cursor, std::size_t firstCluster);
+    void ReopenDirectory(DirectoryCursor &cursor, std::string_view path);
 
-    void CreateDirectoryEntry(std::string_view              path,
-                              const std::vector<std::byte> &data,
-                              bool                          isDirectory);
+    // reads the next cluster of a directory, cut at the end marker; empty
+    // once the directory is exhausted
+    std::span<const Structures::DirectoryEntry>
+    ReadNextDirectoryCluster(DirectoryCursor &cursor);
 
-    [[nodiscard]] std::size_t ExtractCluster(std::size_t clusterNumber) const;
+    struct NewEntry
+    {
+        Helpers::Path::FatName Name;
+        std::size_t            Parent; // DirectoryCursor::FirstCluster
+    };
+
+    // checks that nothing exists at path yet and that its parent does
+    [[nodiscard]] NewEntry PrepareNewEntry(std::string_view path,
+                                           bool             isDirectory);
+
+    [[nodiscard]] Structures::DirectoryEntry
+    MakeDirectoryEntry(const Helpers::Path::FatName &name,
+                       std::uint8_t                  attributes,
+                       std::size_t                   firstCluster,
+                       std::size_t                   fileSize) const;
+
+    DirectorySlots &GetDirectorySlots(std::size_t directory);
+    // returns the offset of the slot used, in bytes
+    std::size_t     InsertDirectoryEntry(std::size_t                       directory,
+                                         const Structures::DirectoryEntry &entry);
+    void ExtendDirectory(std::size_t directory, DirectorySlots &slots);
+
+    [[nodiscard]] std::size_t GetSlotOffset(std::size_t cluster,
+                                            std::size_t index) const;
+
+    [[nodiscard]] EntryLocation FindFile(std::string_view path);
+    [[nodiscard]] EntryLocation FindFile(std::string_view path,
+                                         DirectoryCursor &cursor);
+
+    std::size_t ReadAt(const Structures::DirectoryEntry &entry,
+                       std::size_t                       offset,
+                       std::span<std::byte>              buffer);
+
+    // writes data at offset, growing the chain as needed; FileSize is
+    // updated in location only
+    void WriteAt(EntryLocation             &location,
+                 std::size_t                offset,
+                 std::span<const std::byte> data);
+    void UpdateFileEntry(EntryLocation &location);
+    // in clusters, including any reserved past FileSize
+    [[nodiscard]] std::size_t ChainLength(const Structures::DirectoryEntry &entry);
+    // frees the clusters of entry that size bytes don't need; FileSize is
+    // left alone
+    void ShrinkChain(Structures::DirectoryEntry &entry, std::size_t size);
+
+    // grows the chain of entry to at least clusterCount clusters, of which
+    // there has to be one or more
+    std::vector<Extent> &ReserveClusters(Structures::DirectoryEntry &entry,
+                                         std::size_t                 clusterCount,
+                                         bool                        contiguous);
+
+    [[nodiscard]] std::vector<Extent> &GetExtentMap(std::size_t firstCluster);
+    static void AppendExtents(std::vector<Extent>         &extents,
+                              std::span<const std::size_t> clusters);
+    // cluster at position index in the chain, by binary search
+    [[nodiscard]] static std::size_t
+    LocateCluster(const std::vector<Extent> &extents, std::size_t index);
+
+    // calls function(position, done, count) for each run of contiguous
+    // clusters covering length bytes from offset, position being in the volume
+    template<typename F>
+    void ForEachRun(const std::vector<Extent> &extents,
+                    std::size_t                offset,
+                    std::size_t                length,
+                    F                        &&function) const;
+
+    // allocates and links count clusters; all or nothing
+    std::vector<std::size_t> AllocateClusterChain(std::size_t count);
+    void ReleaseClusters(std::span<const std::size_t> clusters);
+
+    // like AllocateClusterChain, but as one run starting at preferred if
+    // possible; falls back to a fragmented chain if no run is large enough
+    std::vector<std::size_t> AllocateContiguousClusters(std::size_t count,
+                                                        std::size_t preferred);
+    // first cluster of count free clusters in a row, or 0
+    [[nodiscard]] std::size_t FindFreeRun(std::size_t count,
+                                          std::size_t startCluster);
+
+    [[nodiscard]] std::size_t ExtractCluster(std::size_t clusterNumber);
     void SetCluster(std::size_t clusterNumber, std::size_t next);
 
+    [[nodiscard]] std::byte *FatBytes(std::size_t offset);
+    FatPage                 &LoadFatPage(std::size_t page);
+    void                     EvictFatPage();
+    void WriteFatSectors(std::size_t sector, std::size_t count, const std::byte *data);
+
+    void MarkFatEntryDirty(std::size_t clusterNumber);
+    void RepackFat12Sector(std::size_t sector);
+    void FlushFatSectors(std::size_t first, std::size_t last);
+    void FlushFat();
+
+    void ReadFsInfo();
+    void FlushFsInfo();
+    // ends an operation; commits the group once it is large enough
+    void Flush();
+    void Commit();
+
+    // all FAT, FSInfo and directory I/O goes through these, so that it can
+    // be staged while a journal group is open
+    void ReadMetadata(std::size_t offset, void *data, std::size_t size);
+    void WriteMetadata(std::size_t offset, const void *data, std::size_t size);
+
+    [[nodiscard]] std::size_t CountFreeClusters();
+
     [[nodiscard]] std::vector<std::size_t>
-    ExtractClusterChain(std::size_t startCluster) const;
+    ExtractClusterChain(std::size_t startCluster);
+
+    void RemoveEntry(std::string_view path, bool recursive, bool erase);
+    void MarkEntryDeleted(const EntryLocation &location);
+    // erased, if given, collects the freed runs, to be zeroed with ZeroRuns
+    // once the FAT no longer points at them
+    void FreeDirectoryTree(std::size_t          firstCluster,
+                           std::vector<Extent> *erased = nullptr);
+    void FreeClusterChain(std::size_t          firstCluster,
+                          std::vector<Extent> *erased = nullptr);
+    void ZeroRuns(std::span<const Extent> runs);
 
-    [[nodiscard]] std::size_t GetNextFreeCluster(
-        std::size_t startCluster = 1 /* start_cluster + 1 == 2*/) const;
+    [[nodiscard]] std::size_t GetNextFreeCluster();
+    [[nodiscard]] std::size_t GetNextFreeCluster(std::size_t startCluster);
 
     [[nodiscard]] std::size_t ConvertClusterToSector(std::size_t cluster) const;
 
+    [[nodiscard]] bool IsClusterFree(std::size_t cluster);
+    [[nodiscard]] bool IsRootCluster(std::size_t cluster) const;
     [[nodiscard]] bool IsEndOfClusterChain(std::size_t cluster) const;
+    [[nodiscard]] bool IsBadCluster(std::size_t value) const;
+
+    // descriptor for reading the volume beside fstream_, which has to be
+    // flushed first for it to see recent writes; opened once, whichever
+    // thread gets here first
+    int VolumeFd();
+    // reads through VolumeFd; safe to call from several threads
+    void ReadVolume(std::size_t offset, void *data, std::size_t size);
+
+    // what each thread of a walk reads the volume with
+    struct Walker
+    {
+        explicit Walker(Implementation &volume)
+            : Reader{volume}
+        {
+        }
+
+        FatReader              Reader;
+        std::vector<std::byte> Buffer; // a directory cluster, or file data
+    };
+
+    struct PendingDirectory
+    {
+        std::size_t FirstCluster{}; // 0 for the FAT12/FAT16 root directory
+        std::size_t Clusters{};     // valid part of the chain (Check only)
+        std::string Path;
+    };
+
+    // one walker per thread; brings the volume on disk up to date first
+    [[nodiscard]] std::vector<Walker> PrepareWalkers();
+
+    // calls visit(walker, directory, descend) on the walkers' threads for
+    // directory and every directory below it, directory.Path having no
+    // trailing backslash. descend(entry) queues a subdirectory unless it was
+    // reached before (a damaged volume) and returns whether it did. the walk
+    // stops once a visit returns false
+    template<typename F>
+    void WalkTree(std::vector<Walker> &walkers, std::string_view directory, F &&visit);
+
+    // calls function(entry, offset) for the entries in use in a directory
+    // (skipping long names, the volume label, "." and ".."), reading at most
+    // maxClusters clusters of its chain through reader; stops early if
+    // function returns false. firstCluster is 0 for the FAT12/FAT16 root
+    template<typename F>
+    void ScanDirectory(FatReader              &reader,
+                       std::size_t             firstCluster,
+                       std::size_t             maxClusters,
+                       std::vector<std::byte> &buffer,
+                       F                     &&function);
+
+    // consistency check (Check.cpp)
+    struct CheckState;
+
+    // one walk; repairs past a batch are left out and more set, for another
+    // pass to find again
+    CheckReport CheckPass(bool repair, bool &more);
+    void        CheckDirectory(CheckState             &state,
+                               FatReader              &reader,
+                               const PendingDirectory &directory,
+                               std::vector<std::byte> &buffer);
+    std::size_t CheckChain(CheckState        &state,
+                           FatReader         &reader,
+                           std::size_t        firstCluster,
+                           const std::string &path,
+                           std::size_t        entryOffset,
+                           bool               isDirectory);
+
+    // incremental copy from the host (Sync.cpp)
+    void SyncDirectory(const std::filesystem::path &host,
+                       const std::string           &path,
+                       SyncReport                  &report);
+    // rewrites the file at location from host over its existing chain
+    void SyncFile(const std::filesystem::path &host,
+                  std::size_t                  size,
+                  EntryLocation               &location);
+    void SetModificationTime(EntryLocation                        &location,
+                             std::chrono::system_clock::time_point time);
 };
+
+template<typename F>
+void Fatfs::FileAllocationTable::Implementation::ScanDirectory(
+    FatReader              &reader,
+    std::size_t             firstCluster,
+    std::size_t             maxClusters,
+    std::vector<std::byte> &buffer,
+    F                     &&function)
+{
+    using namespace Structures;
+
+    std::size_t cluster = firstCluster;
+
+    for (std::size_t i = 0; i < maxClusters; i++)
+    {
+        buffer.resize(cluster == 0 ? bpb_.RootDirEntries * sizeof(DirectoryEntry)
+                                   : bytesPerCluster_);
+        ReadVolume(GetSlotOffset(cluster, 0), buffer.data(), buffer.size());
+
+        const auto *entries = reinterpret_cast<const DirectoryEntry *>(buffer.data());
+        const std::size_t count = buffer.size() / sizeof(DirectoryEntry);
+
+        for (std::size_t j = 0; j < count; j++)
+        {
+            const DirectoryEntry &entry = entries[j];
+
+            // nothing after the end marker is in use
+            if (entry.Name[0] == 0)
+                return;
+
+            if (entry.Name[0] == 0xE5 ||
+                (entry.Attributes & RawAttributes::LongName) ==
+                    RawAttributes::LongName ||
+                (entry.Attributes & RawAttributes::VolumeId) != 0 ||
+                entry.Name[0] == '.')
+            {
+                continue;
+            }
+
+            if (!function(entry, GetSlotOffset(cluster, j)))
+                return;
+        }
+
+        // the fixed root directory is read in one go
+        if (cluster == 0)
+            return;
+
+        cluster = reader.Next(cluster);
+        if (cluster < 2 || cluster >= fatEntryCount_ ||
+            IsEndOfClusterChain(cluster))
+            return;
+    }
+}
+
+template<typename F>
+void Fatfs::FileAllocationTable::Implementation::WalkTree(
+    std::vector<Walker> &walkers,
+    std::string_view     directory,
+    F                  &&visit)
+{
+    const DirectoryCursor start = OpenDirectory(directory);
+
+    std::string path{directory};
+    while (!path.empty() && path.back() == '\\')
+        path.pop_back();
+
+    ClusterBitmap               visited{fatEntryCount_};
+    WorkQueue<PendingDirectory> directories;
+
+    directories.Push({start.FirstCluster, 0, std::move(path)});
+
+    directories.Run(
+        walkers.size(),
+        [&](std::size_t thread, const PendingDirectory &pending)
+        {
+            const auto descend = [&](const Structures::DirectoryEntry &entry)
+            {
+                const std::size_t firstCluster =
+                    entry.FirstClusterLow | entry.FirstClusterHigh << 16;
+
+                if (firstCluster < 2 || firstCluster >= fatEntryCount_ ||
+                    visited.TestAndSet(firstCluster))
+                    return false;
+
+                directories.Push(
+                    {firstCluster,
+                     0,
+                     pending.Path + "\\" +
+                         Helpers::Path::ConvertFatPathToLongPath(
+                             {reinterpret_cast<const char *>(entry.Name),
+                              std::size(entry.Name) + std::size(entry.Extension)})});
+                return true;
+            };
+
+            if (!visit(walkers[thread], pending, descend))
+                directories.Stop();
+        });
+}
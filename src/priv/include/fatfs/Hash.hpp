@@ -0,0 +1,46 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+
+namespace Fatfs::Hash
+{
+// CRC-32C (Castagnoli), with the SSE4.2 instruction where the CPU has it
+class Crc32c
+{
+  public:
+    void Update(std::span<const std::byte> data);
+
+    [[nodiscard]] std::uint32_t Value() const;
+
+  private:
+    std::uint32_t state_ = 0xFFFFFFFF;
+};
+
+class Sha256
+{
+  public:
+    void Update(std::span<const std::byte> data);
+
+    // the digest as lowercase hex; no more updates after this
+    [[nodiscard]] std::string Finish();
+
+  private:
+    void Compress(const std::byte *block);
+
+    std::array<std::uint32_t, 8> state_{0x6A09E667,
+                                        0xBB67AE85,
+                                        0x3C6EF372,
+                                        0xA54FF53A,
+                                        0x510E527F,
+                                        0x9B05688C,
+                                        0x1F83D9AB,
+                                        0x5BE0CD19};
+    std::array<std::byte, 64>     block_{};
+    std::size_t                   buffered_{}; // bytes in block_
+    std::uint64_t                 length_{};   // total, in bytes
+};
+} // namespace Fatfs::Hash
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace Fatfs
+{
+// write-ahead log of metadata sectors, kept in a sidecar file next to the
+// volume. a group of updates is first appended to the journal as one
+// checksummed record and synced; only then is it written to the volume. a
+// record that made it to the journal is replayed on the next mount, one that
+// didn't is ignored, so the volume never sees half of a group
+class Journal
+{
+  public:
+    // sector images keyed by their offset in the volume, in bytes
+    using Sectors = std::map<std::size_t, std::vector<std::byte>>;
+
+    Journal(std::string_view path, std::string_view volumePath);
+    ~Journal();
+
+    Journal(const Journal &)            = delete;
+    Journal &operator=(const Journal &) = delete;
+
+    // writes every complete record left over from an earlier session to the
+    // volume and empties the journal; returns the number of records applied
+    std::size_t Replay(std::fstream &volume);
+
+    // durably appends one record; once this returns, the group survives a
+    // crash. a record that fails to go out is cut off again; if even that
+    // fails, later commits throw rather than append behind it
+    void Commit(const Sectors &sectors);
+
+    // forgets all records once their sectors are durable in the volume
+    void Checkpoint();
+
+    // makes everything written to the volume so far durable
+    void SyncVolume();
+
+  private:
+    int         fd_       = -1;
+    int         volumeFd_ = -1;
+    std::string path_;
+
+    std::uint32_t sequence_ = 0;
+    bool          broken_   = false; // a torn record may be left at the end
+};
+} // namespace Fatfs
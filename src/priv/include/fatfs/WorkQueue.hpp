@@ -0,0 +1,122 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace Fatfs
+{
+// items handed out to a fixed set of threads; workers may push more items
+// while they run (e.g. subdirectories found in a directory). the first
+// exception a worker throws stops the queue and is rethrown by Run
+template<typename T>
+class WorkQueue
+{
+  public:
+    // one thread per core, within reason
+    [[nodiscard]] static std::size_t DefaultThreadCount()
+    {
+        return std::clamp<std::size_t>(std::thread::hardware_concurrency(), 1, 16);
+    }
+
+    void Push(T item)
+    {
+        {
+            const std::lock_guard lock{mutex_};
+            items_.push_back(std::move(item));
+        }
+
+        changed_.notify_one();
+    }
+
+    // no more items are handed out; those being worked on are finished
+    void Stop()
+    {
+        {
+            const std::lock_guard lock{mutex_};
+            stopped_ = true;
+        }
+
+        changed_.notify_all();
+    }
+
+    [[nodiscard]] bool Stopped() const
+    {
+        return stopped_;
+    }
+
+    // calls worker(thread, item) on threadCount threads until no items are
+    // left and none are being worked on
+    template<typename F>
+    void Run(std::size_t threadCount, F &&worker)
+    {
+        std::vector<std::thread> threads;
+        for (std::size_t i = 0; i < threadCount; i++)
+            threads.emplace_back([&, i] { Work(i, worker); });
+
+        for (std::thread &thread : threads)
+            thread.join();
+
+        if (error_)
+            std::rethrow_exception(error_);
+    }
+
+  private:
+    template<typename F>
+    void Work(std::size_t thread, F &worker)
+    {
+        std::unique_lock lock{mutex_};
+
+        while (true)
+        {
+            // an idle queue with nobody busy can't get new items anymore
+            changed_.wait(lock,
+                          [&]
+                          { return !items_.empty() || busy_ == 0 || stopped_; });
+
+            if (items_.empty() || stopped_)
+                break;
+
+            // last in, first out keeps a tree walk depth first and the
+            // queue short
+            T item = std::move(items_.back());
+            items_.pop_back();
+            busy_++;
+
+            lock.unlock();
+
+            try
+            {
+                worker(thread, item);
+            }
+            catch (...)
+            {
+                lock.lock();
+                if (!error_)
+                    error_ = std::current_exception();
+                stopped_ = true;
+                lock.unlock();
+            }
+
+            lock.lock();
+            busy_--;
+            changed_.notify_all();
+        }
+
+        changed_.notify_all();
+    }
+
+    std::mutex              mutex_; // everything below
+    std::condition_variable changed_;
+    std::vector<T>          items_;
+    std::size_t             busy_{}; // items being worked on
+    std::atomic<bool>       stopped_{};
+    std::exception_ptr      error_;
+};
+} // namespace Fatfs